@@ -1,20 +1,57 @@
-% function [v,SNR] = SNR_local1(u,u0)
+% function [v,SNR] = SNR_local1(u,u0,opt,algo)
 %
 % This function solves : 
 % min ||h(u)-u0||_2^2, where h is a local contrast change defined through the FLST. 
 %
 % INPUT : 
-% - u0: reference image. 
-% - u: image to be compared.
+% - u0: reference image, or stack of K reference images (n0 x n1 x K).
+% - u: image to be compared. For a color image (n0 x n1 x C), u0 must have
+% the same C channels. The tree of shapes is then computed once, on the
+% luminance of u, and each channel of u0 is projected on it.
+% - opt (optional): channel of a color image u whose tree is computed
+% instead of its luminance, or 'volume' if u and u0 are volumes
+% (n0 x n1 x n2), whose tree of shapes is then computed in 3D.
+% - algo (optional, volumes only): 'parallel' (default) to compute the tree
+% of the volume by union-find on all cores, or 'uf' on a single core.
 %
 % OUTPUT: 
-% - v=h(u): optimal contrast changed version of u.
-% - SNR: SNR(v,u0)
+% - v=h(u): optimal contrast changed version of u, one per reference image.
+% - SNR: SNR(v,u0), one per reference image, or one for all the channels.
 %
 % Developers: Pierre Weiss (08/2018)
 
-function [v,SNR] = SNR_local1(u1,u0)
+function [v,SNR] = SNR_local1(u1,u0,opt,algo)
 
+if nargin<3
+    opt=0; % Luminance
+end
+if nargin<4
+    algo='parallel';
+end
+if ischar(opt)
+    if ~strcmp(opt,'volume')
+        error('opt should be a channel or ''volume''');
+    end
+    if ~any(strcmp(algo,{'uf','parallel'}))
+        error('algo should be ''uf'' or ''parallel''');
+    end
+    v=project_llt_mex_double(u1,u0,algo);
+    SNR=-10*log10( norm(v(:)-u0(:))^2 / (norm(u0(:))^2));
+    return
+end
+if size(u1,3)>1
+    if size(u1,3)~=size(u0,3)
+        error('u and u0 should have the same number of channels');
+    end
+    v=project_llt_batch_mex_double(u1,u0,'flst',opt);
+    SNR=-10*log10( norm(v(:)-u0(:))^2 / (norm(u0(:))^2));
+    return
+end
+if size(u0,3)>1
+    % The tree of u1 is computed once for all the references
+    [v,SNR]=project_llt_batch_mex_double(u1,u0);
+    return
+end
 v=project_llt_mex_double(u1,u0);
 SNR=-10*log10( norm(v(:)-u0(:))^2 / (norm(u0(:))^2));
 
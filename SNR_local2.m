@@ -1,4 +1,4 @@
-% function [v,SNR] = SNR_local2(u,u0,eps,nit)
+% function [v,SNR] = SNR_local2(u,u0,eps,nit,tol)
 %
 % This function solves : 
 % min ||h(u)-u0||_2^2, where h is a local contrast change. 
@@ -8,7 +8,11 @@
 % - u0: reference image. 
 % - u: image to be compared.
 % - eps: to ensure strict monotonicity.
-% - nit: number of iterations.
+% - nit: maximal number of iterations.
+% - tol (optional): the iterations stop once the root mean square error of
+% the solution is of the order of tol times the range of the means of u0 on
+% the regions, measured by the duality gap. 0 runs the nit iterations.
+% Default 1e-4.
 %
 % OUTPUT: 
 % - v=h(u): optimal contrast changed version of u.
@@ -16,24 +20,24 @@
 %
 % Developers: Gabriel Bathie, Paul Escande and Pierre Weiss (07/2018)
 
-function [v,SNR] = SNR_local2(u,u0,eps,nit)
+function [v,SNR] = SNR_local2(u,u0,eps,nit,tol)
 
-% Graph construction
-[List,A,W,~]=make_graph(u);
-
-% Here, v0 is the optimal contrast change without adjacency constraints
-v0=zeros(size(u0));
-beta=zeros(length(List),1);
-for i=1:length(List)
-    beta(i)=mean(u0(List(i).PixelIdxList));
-    v0(List(i).PixelIdxList)=beta(i);
+if nargin<5
+    tol=1e-4;
 end
 
-[alpha,~]=isotonic_regression_iterative(A,W,beta,eps,nit);
+% Graph construction: connected components uCC of u, their edges E,
+% E(k,:)=[i,j] meaning that u is larger on i, their number of pixels W and
+% the sums S of u0 on them
+[uCC,E,W,S]=region_graph_mex(u,u0);
 
-v=zeros(size(u));
-for i=1:length(List)
-    v(List(i).PixelIdxList)=alpha(i);
-end
+% Here, beta is the optimal contrast change without adjacency constraints
+beta=S./W;
+
+% Solved by the native version of isotonic_regression_iterative on all the
+% cores
+alpha=isotonic_regression_graph_mex(E,W,beta,eps,nit,tol);
+
+v=alpha(uCC);
 
 SNR=-10*log10( norm(v(:)-u0(:))^2 / (norm(u0(:))^2));
\ No newline at end of file
@@ -0,0 +1,43 @@
+% This is a script to measure the sizes of the messages of the isotonic
+% regression in the projection of an image on the tree of shapes of another,
+% with and without the coalescing of their breakpoints. The sum of the sizes
+% of the messages of the nodes is the work of the dynamic programming.
+% tol=-1 keeps all breakpoints, tol=0 (the default) merges equal ones, which
+% 8 bits images produce in numbers, and a positive tol gives an approximate
+% projection, whose error is reported.
+
+addpath(genpath('./'))
+
+files=dir('images/*.jpg');
+tols=[-1,0,0.01,0.1];
+fprintf('%-10s %-8s %8s %6s %9s %12s %9s %10s %10s\n','Image','Values','#shapes','tol',...
+    'coalesced','sum sizes','largest','reduction','max|err|');
+for k=1:length(files)
+    u=double(imread(files(k).name));
+    u=u(:,:,2); % Make it gray scale
+    u0=double(imread(files(mod(k,length(files))+1).name));
+    u0=u0(:,:,2);
+
+    for quantized=[true,false]
+        if quantized
+            v=u; v0=u0; values='8 bits';
+        else
+            v=conv2(u,ones(3)/9,'same'); v0=conv2(u0,ones(3)/9,'same'); values='float';
+        end
+        % Regression of the means of v0 on the private pixels of the shapes
+        [T,gray,label]=flst_mex(v);
+        N=length(T);
+        w=accumarray(label(:),1,[N,1]);
+        y=accumarray(label(:),v0(:),[N,1])./w;
+        s=ones(N,1);
+        s(2:end)=1-2*(gray(2:end)<gray(T(2:end)));
+
+        [x_ref,stats_ref]=isotonic_regression_tree_mex(T,s,w,y,-1);
+        for tol=tols
+            [x,stats]=isotonic_regression_tree_mex(T,s,w,y,tol);
+            fprintf('%-10s %-8s %8i %6.2g %9i %12i %9i %9.1f%% %10.2e\n',files(k).name,values,...
+                N,tol,stats(2),stats(3),stats(4),100*(1-stats(3)/stats_ref(3)),...
+                max(abs(x-x_ref)));
+        end
+    end
+end
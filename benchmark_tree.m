@@ -0,0 +1,56 @@
+% This is a script to compare the algorithms computing the tree of shapes in
+% project_llt_mex_double: the FLST (contour following) and the union-find
+% algorithm, sequential or parallel. All give the same tree, hence the same
+% projection.
+% The images are used at full resolution, with 8 bits and then with non
+% quantized values (after a small blur), where the FLST is much slower.
+
+addpath(genpath('./'))
+
+files=dir('images/*.jpg');
+fprintf('%-10s %-8s %9s %9s %9s %9s %10s\n','Image','Values','#levels','FLST (s)','UF (s)','Par. (s)','max|diff|');
+for k=1:length(files)
+    u=double(imread(files(k).name));
+    u=u(:,:,2); % Make it gray scale
+    u0=double(imread(files(mod(k,length(files))+1).name));
+    u0=u0(:,:,2);
+    
+    for quantized=[true,false]
+        if quantized
+            v=u; values='8 bits';
+        else
+            v=conv2(u,ones(3)/9,'same'); values='float';
+        end
+        [p_flst,t_flst]=project_llt_mex_double(v,u0,'flst');
+        [p_uf,t_uf]=project_llt_mex_double(v,u0,'uf');
+        % The times returned are CPU times, summed over the threads
+        [p_par,t_par]=project_llt_mex_double(v,u0,'parallel');
+        fprintf('%-10s %-8s %9i %9.3f %9.3f %9.3f %10.2e\n',files(k).name,values,...
+            length(unique(v)),t_flst(1),t_uf(1),t_par(1),...
+            max(abs([p_flst(:)-p_uf(:);p_flst(:)-p_par(:)])));
+    end
+end
+
+% Check of the merge of the tiles of 'parallel' on large flat zones. The CPU
+% time of 'parallel', summed over the threads, should stay close to the one
+% of 'uf' on flat and binary images and volumes.
+fprintf('\n%-10s %-8s %9s %9s %9s\n','Image','Size','UF (s)','Par. (s)','Ratio');
+rng(0);
+names={'flat','binary','flat','binary'};
+sizes={[1024 1024],[1024 1024],[64 64 64],[64 64 32]};
+for k=1:length(names)
+    if strcmp(names{k},'flat')
+        v=ones(sizes{k});
+    else
+        v=double(rand(sizes{k})>0.5);
+    end
+    u0=rand(sizes{k});
+    [p_uf,t_uf]=project_llt_mex_double(v,u0,'uf');
+    [p_par,t_p]=project_llt_mex_double(v,u0,'parallel');
+    fprintf('%-10s %-8s %9.3f %9.3f %9.2f\n',names{k},...
+        strjoin(arrayfun(@num2str,sizes{k},'UniformOutput',false),'x'),...
+        t_uf(1),t_p(1),t_p(1)/t_uf(1));
+    if max(abs(p_uf(:)-p_par(:)))>0 || t_p(1)>2*t_uf(1)+0.1
+        warning('''parallel'' differs from or is much slower than ''uf'' on this image');
+    end
+end
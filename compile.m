@@ -1,7 +1,21 @@
 cd mex_files/
 
-mex project_llt_mex_double.cpp shape_double.cpp tree_double.cpp isotonic_regression_tree.cpp 
+% Set wide to true for images of more than 32767 rows or columns, or of more
+% than 2^31-1 pixels. The pixel lists of the trees then take twice the memory.
+wide = false;
+if wide
+    opt = {'-DLS_WIDE'};
+else
+    opt = {};
+end
+
+mex(opt{:}, 'project_llt_mex_double.cpp', 'shape_double.cpp', 'tree_double.cpp', 'tos_union_find_double.cpp', 'compact_tree_double.cpp', 'project_llt_double.cpp', 'isotonic_regression_tree.cpp')
+mex(opt{:}, 'project_llt_batch_mex_double.cpp', 'flst_double.cpp', 'shape_double.cpp', 'tree_double.cpp', 'tos_union_find_double.cpp', 'compact_tree_double.cpp', 'project_llt_double.cpp', 'isotonic_regression_tree.cpp')
 mex isotonic_regression_tree_mex.cpp isotonic_regression_tree.cpp 
-mex idcc_mex.cpp 
+mex(opt{:}, 'flst_mex.cpp', 'flst_double.cpp', 'shape_double.cpp', 'tree_double.cpp', 'tos_union_find_double.cpp')
+mex snr_global_mex.cpp snr_global.cpp isotonic_regression_tree.cpp
+mex isotonic_regression_graph_mex.cpp isotonic_regression_graph.cpp
+mex region_graph_mex.cpp region_graph.cpp connected_components.cpp
+mex idcc_mex.cpp connected_components.cpp
 
 cd ../
@@ -24,7 +24,7 @@ disp('Local contrast change of type 1')
 tic;[v_loc1,SNR_loc1] = SNR_local1(u,u0);toc;
 
 % Finds best local contrast change of type 2
-disp('Local contrast change of type 2 (may take time)')
+disp('Local contrast change of type 2')
 tic;
 eps=0;nit=5000;
 [v_loc2,SNR_loc2] = SNR_local2(u,u0,eps,nit);
@@ -39,4 +39,15 @@ figure(2);axis equal;imagesc(u,[m M]);title(sprintf('Image to compare SNR:%1.2f'
 
 figure(3);axis equal;imagesc(v_glo,[m M]);title(sprintf('Global contrast change, SNR:%1.2f',SNR_glo));axis off;colormap gray;axis equal;
 figure(4);axis equal;imagesc(v_loc1,[m M]);title(sprintf('Local contrast change 1, SNR:%1.2f',SNR_loc1));axis off;colormap gray;axis equal;
-figure(5);axis equal;imagesc(v_loc2,[m M]);title(sprintf('Local contrast change 2, SNR:%1.2f',SNR_loc2));axis off;colormap gray;axis equal;
\ No newline at end of file
+figure(5);axis equal;imagesc(v_loc2,[m M]);title(sprintf('Local contrast change 2, SNR:%1.2f',SNR_loc2));axis off;colormap gray;axis equal;
+
+%% Local contrast change of type 1 on the color images
+% The tree of shapes of the luminance of u is computed once and the three
+% channels of u0 are projected on it.
+uc0=imresize(double(imread('S2_1.jpg')),[256,256]);
+uc=imresize(double(imread('S2_5.jpg')),[256,256]);
+disp('Local contrast change of type 1, color images')
+tic;[vc_loc1,SNRc_loc1] = SNR_local1(uc,uc0);toc;
+
+figure(6);imshow(uint8(uc0));title('Reference color image');
+figure(7);imshow(uint8(vc_loc1));title(sprintf('Local contrast change 1, SNR:%1.2f',SNRc_loc1));
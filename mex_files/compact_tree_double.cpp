@@ -0,0 +1,128 @@
+#include "compact_tree_double.h"
+#include "tos_union_find_double.h"
+#include "parallel.h"
+#include <limits>
+
+/// Constructor. With the union-find algorithms, the arrays are filled
+/// directly, without allocating the shapes of an \c LsTree.
+template <typename T>
+LsCompactTree::LsCompactTree(const T* g, int w, int h, LsTree::Algo algo)
+: ncol(w), nrow(h), ndep(1), iNbShapes(0) {
+    if(algo == LsTree::FLST) {
+        LsTree tree(g, w, h, algo);
+        *this = LsCompactTree(tree);
+        return;
+    }
+    build(g, (algo == LsTree::PARALLEL)? default_threads(): 1);
+}
+
+/// Constructor for a volume of size \a w x \a h x \a d, stored slice by
+/// slice. The FLST being 2D only, the union-find algorithm is used in any
+/// case, \a algo telling whether it is parallel.
+template <typename T>
+LsCompactTree::LsCompactTree(const T* g, int w, int h, int d,
+                             LsTree::Algo algo)
+: ncol(w), nrow(h), ndep(d), iNbShapes(0) {
+    build(g, (algo == LsTree::PARALLEL)? default_threads(): 1);
+}
+
+/// Fill the arrays with the union-find algorithm.
+template <typename T>
+void LsCompactTree::build(const T* g, int nbThreads) {
+    smallestShape.resize(size());
+    tos_union_find(g, ncol, nrow, ndep, parent, gray, &smallestShape[0],
+                   nbThreads);
+    resize((int)parent.size());
+    for(size_t i = 0; i < size(); i++)
+        area[smallestShape[i]]++;
+    for(int i = iNbShapes-1; i > 0; i--)
+        area[parent[i]] += area[i];
+    for(int i = 1; i < iNbShapes; i++)
+        type[i] = (gray[i] < gray[parent[i]])? LsShape::INF: LsShape::SUP;
+    link();
+}
+
+/// Conversion of an \c LsTree, whose ignored shapes are removed in linear
+/// time as in \c LsTree::compact(). If more than 2^31-1 shapes are kept, the
+/// tree is left empty.
+LsCompactTree::LsCompactTree(const LsTree& tree)
+: ncol(tree.ncol), nrow(tree.nrow), ndep(1), iNbShapes(0) {
+    std::vector<LsIndex> index;
+    LsIndex n = tree.index_kept_shapes(index);
+    if(n > std::numeric_limits<int32_t>::max())
+        return;
+    resize((int)n);
+    parent.resize(iNbShapes);
+    gray.resize(iNbShapes);
+    for(LsIndex i = 0; i < tree.iNbShapes; i++) {
+        const LsShape& s = tree.shape(i);
+        if(s.bIgnore)
+            continue;
+        LsIndex k = index[i];
+        parent[k] = s.parent? index[s.parent->shapeId]: -1;
+        gray[k] = s.gray;
+        area[k] = s.area;
+        type[k] = s.type;
+    }
+    smallestShape.resize(size());
+    for(size_t i = 0; i < size(); i++)
+        smallestShape[i] = (int32_t)index[tree.smallestShape[i]->shapeId];
+    link();
+}
+
+/// Reconstruct an image from the tree
+double* LsCompactTree::build_image() const {
+    double* out = new double[size()];
+    build_image(out);
+    return out;
+}
+
+/// Reconstruct an image from the tree in \a out, of size \c size().
+template <typename T>
+void LsCompactTree::build_image(T* out) const {
+    for(size_t i = 0; i < size(); i++)
+        out[i] = (T)gray[smallestShape[i]];
+}
+
+/// Number of bytes used by the arrays.
+size_t LsCompactTree::memory() const {
+    return (parent.size()+child.size()+sibling.size()+
+            smallestShape.size()) * sizeof(int32_t) +
+        area.size()*sizeof(LsIndex) + gray.size()*sizeof(double) + type.size();
+}
+
+/// Estimate of the number of bytes used by the arrays of the tree of an
+/// image of \a nbPixels pixels having \a nbShapes shapes.
+size_t LsCompactTree::memory_estimate(size_t nbPixels, size_t nbShapes) {
+    return (3*nbShapes + nbPixels) * sizeof(int32_t) +
+        nbShapes * (sizeof(LsIndex)+sizeof(double)+1);
+}
+
+/// Set the number of shapes, resetting the fields other than parent and gray.
+void LsCompactTree::resize(int nbShapes) {
+    iNbShapes = nbShapes;
+    child.assign(iNbShapes, -1);
+    sibling.assign(iNbShapes, -1);
+    area.assign(iNbShapes, 0);
+    type.assign(iNbShapes, LsShape::SUP);
+}
+
+/// Set children and siblings from parents. Each shape must come after its
+/// parent.
+void LsCompactTree::link() {
+    for(int i = 1; i < iNbShapes; i++) {
+        int32_t p = parent[i];
+        sibling[i] = child[p];
+        child[p] = i;
+    }
+}
+
+#define INSTANTIATE(T) \
+template LsCompactTree::LsCompactTree(const T*, int, int, LsTree::Algo); \
+template LsCompactTree::LsCompactTree(const T*, int, int, int, LsTree::Algo); \
+template void LsCompactTree::build_image(T*) const;
+INSTANTIATE(uint8_t)
+INSTANTIATE(uint16_t)
+INSTANTIATE(float)
+INSTANTIATE(double)
+#undef INSTANTIATE
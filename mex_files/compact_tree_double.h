@@ -0,0 +1,122 @@
+#ifndef COMPACT_TREE_H
+#define COMPACT_TREE_H
+
+#include "tree_double.h"
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/// Tree of shapes stored as parallel arrays indexed by shape.
+/// Links are 32-bit indices, -1 meaning none, and the root is shape 0, while
+/// areas are \c LsIndex, 64-bit with LS_WIDE. Only the fields needed to walk
+/// the tree and project an image on it are kept: no pixel lists, contours or
+/// ignored shapes. A tree with too many shapes for 32-bit links is left
+/// empty, with no shape.
+/// Pixels may be of type uint8_t, uint16_t, float or double.
+struct LsCompactTree {
+    template <typename T>
+    LsCompactTree(const T* gray, int w, int h,
+                  LsTree::Algo algo = LsTree::FLST);
+    template <typename T>
+    LsCompactTree(const T* gray, int w, int h, int d, LsTree::Algo algo);
+    explicit LsCompactTree(const LsTree& tree);
+
+    double* build_image() const;
+    template <typename T> void build_image(T* out) const;
+    size_t memory() const; ///< Number of bytes used by the arrays
+    static size_t memory_estimate(size_t nbPixels, size_t nbShapes);
+    size_t size() const { return (size_t)ncol*nrow*ndep; } ///< Number of pixels
+
+    int ncol, nrow; ///< Dimensions of image
+    int ndep; ///< Depth of a volume, 1 for an image
+    int iNbShapes; ///< The number of shapes
+
+    // Tree structure
+    std::vector<int32_t> parent;  ///< Smallest containing shape
+    std::vector<int32_t> child;   ///< First child
+    std::vector<int32_t> sibling; ///< Siblings are linked
+
+    std::vector<double> gray; ///< Gray level of the shapes
+    std::vector<LsIndex> area; ///< Number of pixels in the shapes
+    std::vector<unsigned char> type; ///< LsShape::INF or LsShape::SUP
+
+    /// For each pixel, the smallest shape containing it
+    std::vector<int32_t> smallestShape;
+private:
+    template <typename T> void build(const T* gray, int nbThreads);
+    void resize(int nbShapes);
+    void link();
+};
+
+/// To walk the compact tree in pre- or post-order
+class LsCompactTreeIterator {
+public:
+    typedef enum { Pre, Post } Order;
+    LsCompactTreeIterator(Order ord, const LsCompactTree& tree, int32_t shape);
+
+    int32_t operator*() const;
+    bool operator==(const LsCompactTreeIterator& it) const;
+    bool operator!=(const LsCompactTreeIterator& it) const;
+    LsCompactTreeIterator& operator++();
+    static LsCompactTreeIterator end(Order ord, const LsCompactTree& tree,
+                                     int32_t shape);
+private:
+    int32_t go_bottom(int32_t shape) const;
+    int32_t uncle(int32_t shape) const;
+    const LsCompactTree* t;
+    int32_t s;
+    Order o;
+};
+
+inline LsCompactTreeIterator::LsCompactTreeIterator(Order ord,
+        const LsCompactTree& tree, int32_t shape)
+: t(&tree), s(shape), o(ord) {
+    if(ord == Post && s >= 0)
+        s = go_bottom(s);
+}
+
+inline bool LsCompactTreeIterator::operator==(
+        const LsCompactTreeIterator& it) const
+{ return (s == it.s); }
+
+inline bool LsCompactTreeIterator::operator!=(
+        const LsCompactTreeIterator& it) const
+{ return !(*this == it); }
+
+inline int32_t LsCompactTreeIterator::operator*() const
+{ return s; }
+
+inline int32_t LsCompactTreeIterator::go_bottom(int32_t shape) const {
+    while(t->child[shape] >= 0)
+        shape = t->child[shape];
+    return shape;
+}
+
+inline int32_t LsCompactTreeIterator::uncle(int32_t shape) const {
+    while(shape >= 0 && t->sibling[shape] < 0)
+        shape = t->parent[shape];
+    return (shape < 0)? -1: t->sibling[shape];
+}
+
+inline LsCompactTreeIterator& LsCompactTreeIterator::operator++() {
+    if(o == Pre)
+        s = (t->child[s] >= 0)? t->child[s]: uncle(s);
+    else // (o == Post)
+        s = (t->sibling[s] >= 0)? go_bottom(t->sibling[s]): t->parent[s];
+    return *this;
+}
+
+inline LsCompactTreeIterator LsCompactTreeIterator::end(Order ord,
+        const LsCompactTree& tree, int32_t shape) {
+    LsCompactTreeIterator it(Pre, tree, shape);
+    it.o = ord;
+    if(shape >= 0) {
+        if(ord == Pre)
+            it.s = it.uncle(shape);
+        else // (ord == Post)
+            ++it;
+    }
+    return it;
+}
+
+#endif
@@ -0,0 +1,216 @@
+#include "connected_components.h"
+#include "parallel.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+// Columns per strip below which threads are not worth it
+static const int MIN_STRIP = 16;
+
+/// Runs of the columns of an image and their union-find. The runs are
+/// numbered in column major order, so that the root of a component, its run
+/// of smallest index, holds its first pixel.
+struct Runs {
+    std::vector<int32_t> column; ///< First run of each column, and total
+    std::vector<int32_t> begin; ///< First pixel of each run
+    std::vector<int32_t> parent; ///< Smaller run of the same component
+    std::vector<int32_t> id; ///< Label of the component of each run
+    std::vector<int> strip; ///< First column of each strip, and total
+
+    template <typename T>
+    int32_t build(const T* u, int h, int w, int32_t first, int nbThreads);
+
+    int32_t find(int32_t r) {
+        while(parent[r] != r)
+            r = parent[r] = parent[parent[r]];
+        return r;
+    }
+    void unite(int32_t a, int32_t b) {
+        a = find(a);
+        b = find(b);
+        if(a < b)
+            parent[b] = a;
+        else if(b < a)
+            parent[a] = b;
+    }
+    /// Merge the runs of columns x-1 and x of equal values that overlap
+    template <typename T>
+    void merge(const T* u, int h, int x) {
+        const int32_t offset = (int32_t)x*h;
+        int32_t a = column[x-1], b = column[x];
+        const int32_t aEnd = column[x], bEnd = column[x+1];
+        while(a < aEnd && b < bEnd) {
+            // Rows of the runs, ends excluded
+            const int32_t ya = begin[a] - (offset-h), yb = begin[b] - offset;
+            const int32_t za = (a+1 < aEnd)? begin[a+1] - (offset-h): h;
+            const int32_t zb = (b+1 < bEnd)? begin[b+1] - offset: h;
+            if(ya < zb && yb < za && u[begin[a]] == u[begin[b]])
+                unite(a, b);
+            if(za <= zb)
+                a++;
+            else
+                b++;
+        }
+    }
+};
+
+/// Runs of u merged in their components, labelled from \a first. Returns
+/// the number of components.
+template <typename T>
+int32_t Runs::build(const T* u, int h, int w, int32_t first, int nbThreads) {
+    nbThreads = std::max(1, std::min(nbThreads, w / MIN_STRIP));
+    strip.resize(nbThreads+1);
+    for(int t = 0; t <= nbThreads; t++)
+        strip[t] = (int)((long long)w*t/nbThreads);
+
+    // Runs counted by column, then numbered
+    column.assign(w+1, 0);
+    parallel_for(nbThreads, nbThreads, [&](int t) {
+        for(int x = strip[t]; x < strip[t+1]; x++) {
+            const T* col = u + (size_t)x*h;
+            int32_t n = 1;
+            for(int y = 1; y < h; y++)
+                n += (col[y] != col[y-1]);
+            column[x+1] = n;
+        }
+    });
+    for(int x = 0; x < w; x++)
+        column[x+1] += column[x];
+    const int32_t nbRuns = column[w];
+    begin.resize(nbRuns);
+    parent.resize(nbRuns);
+
+    // Runs of each strip, merged inside the strip
+    parallel_for(nbThreads, nbThreads, [&](int t) {
+        for(int x = strip[t]; x < strip[t+1]; x++) {
+            const int32_t offset = (int32_t)x*h;
+            int32_t r = column[x];
+            for(int y = 0; y < h; y++)
+                if(y == 0 || u[offset+y] != u[offset+y-1]) {
+                    begin[r] = offset+y;
+                    parent[r] = r;
+                    r++;
+                }
+            if(x > strip[t])
+                merge(u, h, x);
+        }
+    });
+    // Borders of the strips
+    for(int t = 1; t < nbThreads; t++)
+        merge(u, h, strip[t]);
+
+    // The parent of a run being before it, the roots are found in one pass
+    // and numbered in order, parent becoming the root
+    id.resize(nbRuns);
+    int32_t next = first;
+    for(int32_t r = 0; r < nbRuns; r++) {
+        const int32_t p = parent[r];
+        if(p == r)
+            id[r] = next++;
+        else
+            id[r] = id[parent[r] = parent[p]];
+    }
+    return next - first;
+}
+
+template <typename T>
+int32_t connected_components(const T* u, int h, int w, int32_t* label,
+                             int32_t first, int nbThreads)
+{
+    if(h <= 0 || w <= 0)
+        return 0;
+    Runs runs;
+    const int32_t nb = runs.build(u, h, w, first, nbThreads);
+    const int32_t n = (int32_t)h*w;
+    nbThreads = (int)runs.strip.size()-1;
+    parallel_for(nbThreads, nbThreads, [&](int t) {
+        const int32_t rEnd = runs.column[runs.strip[t+1]];
+        for(int32_t r = runs.column[runs.strip[t]]; r < rEnd; r++) {
+            const int32_t end = (r+1 < runs.column[w])? runs.begin[r+1]: n;
+            std::fill(label + runs.begin[r], label + end, runs.id[r]);
+        }
+    });
+    return nb;
+}
+
+void ComponentStats::resize(int32_t n, int k) {
+    K = k;
+    area.assign(n, 0);
+    xmin.assign(n, std::numeric_limits<int32_t>::max());
+    ymin.assign(n, std::numeric_limits<int32_t>::max());
+    xmax.assign(n, -1);
+    ymax.assign(n, -1);
+    sum.assign((size_t)n*K, 0);
+    sum2.assign((size_t)n*K, 0);
+}
+
+template <typename T, typename T0>
+int32_t connected_components(const T* u, int h, int w, int32_t* label,
+                             const T0* v, int K, ComponentStats& stats,
+                             int32_t first, int nbThreads)
+{
+    stats.resize(0, K);
+    if(h <= 0 || w <= 0)
+        return 0;
+    Runs runs;
+    const int32_t nb = runs.build(u, h, w, first, nbThreads);
+    stats.resize(nb, K);
+    const size_t n = (size_t)h*w;
+    const int32_t nbRuns = runs.column[w];
+    nbThreads = (int)runs.strip.size()-1;
+
+    // Statistics of the runs added to their component, by the thread of the
+    // strip of its first run. The other runs, of components started in a
+    // previous strip, are kept with their sums and added afterwards.
+    std::vector<std::vector<int32_t> > foreignRuns(nbThreads);
+    std::vector<std::vector<double> > foreignSums(nbThreads);
+    parallel_for(nbThreads, nbThreads, [&](int t) {
+        const int32_t rBegin = runs.column[runs.strip[t]];
+        const int32_t rEnd = runs.column[runs.strip[t+1]];
+        std::vector<double> s(2*K);
+        for(int32_t r = rBegin; r < rEnd; r++) {
+            const int32_t b = runs.begin[r];
+            const int32_t e = (r+1 < nbRuns)? runs.begin[r+1]: (int32_t)n;
+            std::fill(label + b, label + e, runs.id[r]);
+            for(int k = 0; k < K; k++) {
+                const T0* vk = v + k*n;
+                double sk = 0, s2k = 0;
+                for(int32_t p = b; p < e; p++) {
+                    sk += vk[p];
+                    s2k += (double)vk[p]*vk[p];
+                }
+                s[2*k] = sk;
+                s[2*k+1] = s2k;
+            }
+            if(runs.parent[r] >= rBegin)
+                stats.add(runs.id[r]-first, b, e, h, s.data());
+            else {
+                foreignRuns[t].push_back(r);
+                foreignSums[t].insert(foreignSums[t].end(), s.begin(), s.end());
+            }
+        }
+    });
+    for(int t = 0; t < nbThreads; t++)
+        for(size_t i = 0; i < foreignRuns[t].size(); i++) {
+            const int32_t r = foreignRuns[t][i];
+            const int32_t e = (r+1 < nbRuns)? runs.begin[r+1]: (int32_t)n;
+            stats.add(runs.id[r]-first, runs.begin[r], e, h,
+                      foreignSums[t].data() + 2*K*i);
+        }
+    return nb;
+}
+
+#define INSTANTIATE(T, T0) \
+template int32_t connected_components(const T*, int, int, int32_t*, \
+                                      const T0*, int, ComponentStats&, \
+                                      int32_t, int);
+#define INSTANTIATE_ALL(T) \
+template int32_t connected_components(const T*, int, int, int32_t*, int32_t, int); \
+INSTANTIATE(T, uint8_t) \
+INSTANTIATE(T, uint16_t) \
+INSTANTIATE(T, float) \
+INSTANTIATE(T, double)
+INSTANTIATE_ALL(uint8_t)
+INSTANTIATE_ALL(uint16_t)
+INSTANTIATE_ALL(float)
+INSTANTIATE_ALL(double)
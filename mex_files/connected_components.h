@@ -0,0 +1,62 @@
+#ifndef CONNECTED_COMPONENTS_H
+#define CONNECTED_COMPONENTS_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/// Label the 4-connected components of constant gray level of the image
+/// \a u of \a h rows and \a w columns in column major order, numbered from
+/// \a first in the order of their first pixel. Returns their number.
+///
+/// The columns are cut into runs of equal pixels, and the runs of adjacent
+/// columns that overlap with the same value are merged in a union-find
+/// whose roots are the first runs of the components. The image is split
+/// into strips of columns, one per thread, merged along their borders
+/// afterwards. The labels are written once, in \a label. No memory is
+/// allocated per pixel, only per run.
+/// Pixels may be of type uint8_t, uint16_t, float or double.
+template <typename T>
+int32_t connected_components(const T* u, int h, int w, int32_t* label,
+                             int32_t first = 0, int nbThreads = 1);
+
+/// Statistics of the components, in dense arrays indexed by component:
+/// area, bounding box and sum and sum of squares of K images on them.
+struct ComponentStats {
+    int K; ///< Number of images summed
+    std::vector<int32_t> area; ///< Number of pixels
+    std::vector<int32_t> xmin, xmax; ///< First and last columns
+    std::vector<int32_t> ymin, ymax; ///< First and last rows
+    /// Sum and sum of squares of image k on component i at k*N+i, N being
+    /// the number of components
+    std::vector<double> sum, sum2;
+
+    void resize(int32_t n, int k);
+    /// Add the pixels [b,e) of one column of an image of \a h rows to
+    /// component \a i, \a s being their sum and sum of squares in each image
+    void add(int32_t i, int32_t b, int32_t e, int h, const double* s) {
+        const size_t N = area.size();
+        const int32_t x = b / h, y = b - x*h;
+        area[i] += e - b;
+        if(x < xmin[i]) xmin[i] = x;
+        if(x > xmax[i]) xmax[i] = x;
+        if(y < ymin[i]) ymin[i] = y;
+        if(y + (e-b) - 1 > ymax[i]) ymax[i] = y + (e-b) - 1;
+        for(int k = 0; k < K; k++) {
+            sum[k*N+i] += s[2*k];
+            sum2[k*N+i] += s[2*k+1];
+        }
+    }
+};
+
+/// Same as above, also computing the \a stats of the components in the
+/// sweep writing the labels. The K images \a v, of the size of u, are
+/// contiguous: pixel p of image k is at v[k*h*w+p]. The runs of each strip
+/// are summed by its thread, and added directly to the components starting
+/// in the strip, the others afterwards.
+template <typename T, typename T0>
+int32_t connected_components(const T* u, int h, int w, int32_t* label,
+                             const T0* v, int K, ComponentStats& stats,
+                             int32_t first = 0, int nbThreads = 1);
+
+#endif
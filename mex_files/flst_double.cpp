@@ -3,17 +3,29 @@
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <limits>
+#include <stdint.h>
 
-#define MAX 1e100
-#define MIN -1e100
+/// Gray levels beyond those of all pixels, whatever their type
+static const double MAX = std::numeric_limits<double>::infinity();
+static const double MIN = -std::numeric_limits<double>::infinity();
 
-struct cimage {
+/// Dimensions of the image
+struct Domain {
     int nrow, ncol;
-    const double* gray;
+    LsIndex index(LsPoint pt) const ///< Index of pixel \a pt
+    { return (LsIndex)pt.y*ncol + pt.x; }
 };
-typedef cimage* Cimage;
-inline double gray(Cimage im, LsPoint pt)
-{ return im->gray[pt.y*im->ncol+pt.x]; }
+typedef const Domain* Cdomain;
+
+/// Image with pixels of type \a T
+template <typename T>
+struct cimage : public Domain {
+    const T* gray;
+};
+template <typename T>
+inline T gray(const cimage<T>* im, LsPoint pt)
+{ return im->gray[im->index(pt)]; }
 
 /// Strict comparison between numbers
 #define COMPARE(t,a,b) (t==LsShape::INF? (a<b): (a>b))
@@ -53,36 +65,37 @@ static DirEdgel turn_180(DirEdgel dir) {
 /// Edgel, vertical or horizontal boundary between adjacent pixels.
 class Edgel {
 public:
-        Edgel(short int x, short int y, DirEdgel d);
+        Edgel(LsCoord x, LsCoord y, DirEdgel d);
         
         bool operator==(const Edgel& e) const
         { return (pt.x == e.pt.x && pt.y == e.pt.y && dir == e.dir); }
         bool operator!=(const Edgel& e) const
         { return ! (e == *this); }
         
-        bool inverse(Cimage im);
+        bool inverse(Cdomain im);
         LsPoint origin() const;
-        bool exterior(LsPoint& ext, Cimage im) const;
-        bool go_straight(Cimage im);
-        void next(Cimage im, LsShape::Type type, double level);
+        bool exterior(LsPoint& ext, Cdomain im) const;
+        bool go_straight(Cdomain im);
+        template <typename T>
+        void next(const cimage<T>* im, LsShape::Type type, double level);
         
         LsPoint pt; ///< Interior pixel coordinates (left of edgel direction)
         DirEdgel dir; ///< Direction of edgel
 private:
         void turn_left(int connect);
         void turn_right(int connect);
-        void finish_turn(Cimage im, int connect);
+        void finish_turn(Cdomain im, int connect);
 };
 
 /// Constructor.
-Edgel::Edgel(short int x, short int y, DirEdgel d)
+Edgel::Edgel(LsCoord x, LsCoord y, DirEdgel d)
 : pt(), dir(d) {
     pt.x = x;
     pt.y = y;
 }
 
 /// Change to inverse edgel
-bool Edgel::inverse(Cimage im) {
+bool Edgel::inverse(Cdomain im) {
     if(! exterior(pt, im))
         return false;
     dir = turn_180(dir);
@@ -91,7 +104,7 @@ bool Edgel::inverse(Cimage im) {
 
 /// Exterior pixel of edgel.
 /// Return \a false if we are an image boundary edgel.
-bool Edgel::exterior(LsPoint& ext, Cimage im) const {
+bool Edgel::exterior(LsPoint& ext, Cdomain im) const {
     ext = pt;
     switch(dir) {
         case EAST:  return (++ext.y < im->nrow);
@@ -109,7 +122,7 @@ bool Edgel::exterior(LsPoint& ext, Cimage im) const {
 
 /// Go straight along current direction.
 /// Return \c false if we end up outside the image.
-bool Edgel::go_straight(Cimage im) {
+bool Edgel::go_straight(Cdomain im) {
     switch(dir) {
         case EAST:  return (++pt.x < im->ncol);
         case NORTH: return (--pt.y >= 0);
@@ -142,7 +155,7 @@ void Edgel::turn_right(int connect) {
 }
 
 /// Finish a left or right turn.
-inline void Edgel::finish_turn(Cimage im, int connect) {
+inline void Edgel::finish_turn(Cdomain im, int connect) {
     dir -= DIAGONAL;
     if(connect == 4)
         go_straight(im);
@@ -151,7 +164,8 @@ inline void Edgel::finish_turn(Cimage im, int connect) {
 }
 
 /// Move to next edgel along the level line.
-void Edgel::next(Cimage im, LsShape::Type type, double level) {
+template <typename T>
+void Edgel::next(const cimage<T>* im, LsShape::Type type, double level) {
     int connect = connectivity(type);
     if(dir >= DIAGONAL) {
         finish_turn(im, connect);
@@ -191,7 +205,8 @@ inline LsPoint Edgel::origin() const {
 
 /// Initialize shape \a s, whose edgel \a e is on the boundary. One pixel of
 /// the private area is found. \a level is the gray level of the parent.
-static void init_shape(Cimage im, LsTree& tree,
+template <typename T>
+static void init_shape(const cimage<T>* im, LsTree& tree,
         LsShape& s, const Edgel& e, double level) {
     
     
@@ -201,13 +216,22 @@ static void init_shape(Cimage im, LsTree& tree,
     s.bIgnore = false;
     s.bBoundary = false;
     s.area = 1;
+    s.contourSize = 0;
     
     Edgel cur = e;
+    LsPoint last;
     do {
-        int j = cur.pt.y * im->ncol + cur.pt.x;
+        LsIndex j = im->index(cur.pt);
         double v = im->gray[j];
-        if(cur.dir < DIAGONAL)
-            s.contour.push_back(cur.origin());
+        if(tree.bContours && cur.dir < DIAGONAL) {
+            LsPoint pt = cur.origin();
+            if(s.contourSize++ == 0) {
+                s.contourStart = pt;
+                s.contourCode = tree.contours.size();
+            } else
+                tree.contours.push(last, pt);
+            last = pt;
+        }
         if(! COMPARE(s.type, v, s.gray)) {
             s.gray = v;
             s.pixels[0] = cur.pt;
@@ -217,7 +241,7 @@ static void init_shape(Cimage im, LsTree& tree,
         cur.next(im, s.type, level);
     } while(cur != e);
     
-    int i = s.pixels[0].y*im->ncol+s.pixels[0].x;
+    LsIndex i = im->index(s.pixels[0]);
     tree.smallestShape[i] = &s;
 }
 
@@ -225,18 +249,20 @@ static void init_shape(Cimage im, LsTree& tree,
 /// on the immediate exterior at the gray level of \a s are added to the
 /// private area. The pixels on the immediate interior are marked as if they
 /// were in the private area of \a s, to avoid following again the boundary.
-static void find_child(Cimage im, LsTree& tree, LsShape& s, const Edgel& e) {
+template <typename T>
+static void find_child(const cimage<T>* im, LsTree& tree, LsShape& s,
+        const Edgel& e) {
     LsShape::Type type = (gray(im,e.pt) < s.gray)? LsShape::INF: LsShape::SUP;
     
     Edgel cur = e;
     do {
-        int i = cur.pt.y * im->ncol + cur.pt.x;
+        LsIndex i = im->index(cur.pt);
         assert(COMPARE(type, im->gray[i], s.gray));
         assert(tree.smallestShape[i] == 0 || tree.smallestShape[i] == &s);
         tree.smallestShape[i] = &s;
         LsPoint pt;
         if(cur.exterior(pt, im)) {
-            i = pt.y * im->ncol + pt.x;
+            i = im->index(pt);
             if(tree.smallestShape[i] == 0 && EQUAL(im->gray[i], s.gray)){//im->gray[i] == s.gray) {
                 s.pixels[s.area++] = pt;
                 tree.smallestShape[i] = &s;
@@ -257,14 +283,15 @@ inline bool edge8(double vi, double ve) {
 /// the child shape, adding to the private area the pixels on its immediate
 /// exterior at level of \a s.
 /// Return whether the edge belongs to the shape and is on its boundary.
-static bool add_neighbor(Cimage im, LsTree& tree, LsShape& s, Edgel e,
+template <typename T>
+static bool add_neighbor(const cimage<T>* im, LsTree& tree, LsShape& s, Edgel e,
         std::vector<Edgel>& children) {
     if(! e.inverse(im)) {
         s.bBoundary = true;
         return false;
     }
     //std::cout<<"inversed im" <<std::endl;
-    int i = e.pt.y*im->ncol + e.pt.x;
+    LsIndex i = im->index(e.pt);
     //std::cout<<"before if" <<std::endl;
     if(! tree.smallestShape[i]) {
         //std::cout<<"first if true" <<std::endl;
@@ -287,13 +314,14 @@ static bool add_neighbor(Cimage im, LsTree& tree, LsShape& s, Edgel e,
 
 /// Fill the private area of shape \a s and find its children.
 /// Put in \a children one seed edgel per child.
-static void find_children(Cimage im, LsTree& tree, LsShape& s,
+template <typename T>
+static void find_children(const cimage<T>* im, LsTree& tree, LsShape& s,
         std::vector<Edgel>& children) {
     
     // std::cout<<"searching children" <<std::endl;
-    for(int i = 0; i < s.area; i++) {
+    for(LsIndex i = 0; i < s.area; i++) {
         const LsPoint& pt = s.pixels[i];
-        assert(tree.smallestShape[pt.y*im->ncol+pt.x] == &s);
+        assert(tree.smallestShape[im->index(pt)] == &s);
         
         //   std::cout<<"asserted OK" <<std::endl;
         Edgel e(pt.x, pt.y, EAST);
@@ -317,50 +345,95 @@ static void find_children(Cimage im, LsTree& tree, LsShape& s,
 /// Fields other than family pointers are initialized later in \c init_shape().
 static LsShape* add_child(LsTree& tree, LsShape& parent) {
     LsShape* old = parent.child;
-    parent.child = &tree.shapes[tree.iNbShapes++];
+    parent.child = tree.new_shape();
     parent.child->parent = &parent;
     parent.child->sibling = old;
     parent.child->child = 0;
     return parent.child;
 }
 
+/// A shape whose children are being extracted. Its seed edgels are stored in
+/// the range [begin,end) of the shared seed stack, \c next being the first
+/// one not yet processed.
+struct TreeFrame {
+    LsShape* shape;
+    size_t begin, next, end;
+    LsIndex iPixels; ///< Offset in \c shape->pixels of the next child's pixels
+};
+
+/// Fill the private area of shape \a s, whose boundary is already
+/// initialized, and push it on \a stack with its children seeds.
+template <typename T>
+static void open_shape(const cimage<T>* im, LsTree& tree, LsShape& s,
+        std::vector<Edgel>& seeds, std::vector<TreeFrame>& stack) {
+    TreeFrame f;
+    f.shape = &s;
+    f.begin = f.next = seeds.size();
+    find_children(im, tree, s, seeds);
+    f.end = seeds.size();
+    f.iPixels = s.area;
+    stack.push_back(f);
+}
+
 /// Extract tree of shapes rooted at \a root.
+/// The traversal is depth-first as in the original recursive version, so
+/// shapes are numbered and their pixels laid out identically, but pending
+/// work is kept on the heap: memory is bounded by the number of shapes
+/// whatever the depth of the tree.
 /// \param im the input image.
 /// \param tree the output tree, where newly extracted shapes are appended.
 /// \param root the current root of the tree.
 /// \param e an edgel at the boundary of \a root.
 /// \param level gray level of parent.
-static void create_tree(Cimage im, LsTree& tree, LsShape& root,
+template <typename T>
+static void create_tree(const cimage<T>* im, LsTree& tree, LsShape& root,
         const Edgel& e, double level) {
-        
-    init_shape(im, tree, root, e, level);
-    
-    std::vector<Edgel> children;
-    find_children(im, tree, root, children);
+    std::vector<Edgel> seeds;
+    std::vector<TreeFrame> stack;
     
-    int iPixels = root.area;
-    std::vector<Edgel>::const_iterator it = children.begin();
+    init_shape(im, tree, root, e, level);
+    open_shape(im, tree, root, seeds, stack);
     
-    for(; it != children.end(); ++it) {
-        LsShape* child = add_child(tree, root);
-        child->pixels = root.pixels + iPixels;
-        create_tree(im, tree, *child, *it, root.gray);
-        root.area += child->area;
-        iPixels += child->area;
+    while(! stack.empty()) {
+        TreeFrame& f = stack.back();
+        if(f.next == f.end) { // All children done: report area to parent
+            LsShape* s = f.shape;
+            seeds.erase(seeds.begin() + f.begin, seeds.end());
+            stack.pop_back();
+            if(! stack.empty()) {
+                stack.back().shape->area += s->area;
+                stack.back().iPixels += s->area;
+            }
+            continue;
+        }
+        Edgel seed = seeds[f.next++];
+        LsShape* parent = f.shape;
+        LsShape* child = add_child(tree, *parent);
+        child->pixels = parent->pixels + f.iPixels;
+        init_shape(im, tree, *child, seed, parent->gray);
+        open_shape(im, tree, *child, seeds, stack); // Invalidates f
     }
 }
 
 /// Top-down FLST algorithm.
-void LsTree::flst_td(const double* gray) {
-    cimage image = {nrow, ncol, gray};
-    int area = ncol * nrow;
+template <typename T>
+void LsTree::flst_td(const T* gray) {
+    cimage<T> image;
+    image.nrow = nrow;
+    image.ncol = ncol;
+    image.gray = gray;
+    LsIndex area = (LsIndex)ncol * nrow;
     
-    for(int i = area-1; i >= 0; i--)
+    for(LsIndex i = area-1; i >= 0; i--)
         smallestShape[i] = 0;
     
-    shapes[0].type = LsShape::SUP;
-    shapes[0].pixels = new LsPoint[area];
+    shape(0).type = LsShape::SUP;
     Edgel e(0, 0, SOUTH);
-    create_tree(&image, *this, shapes[0], e, -1);
-    assert(area == shapes[0].area);
-}
\ No newline at end of file
+    create_tree(&image, *this, shape(0), e, MIN);
+    assert(area == shape(0).area);
+}
+
+template void LsTree::flst_td(const uint8_t* gray);
+template void LsTree::flst_td(const uint16_t* gray);
+template void LsTree::flst_td(const float* gray);
+template void LsTree::flst_td(const double* gray);
\ No newline at end of file
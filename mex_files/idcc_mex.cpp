@@ -7,137 +7,133 @@
  * major format, i.e. for an array representing a matrix with m lines and n columns,
  * array[k] = matrix[x*n + y]
  *
+ * The components are labelled by runs of the columns and union-find, on
+ * strips of columns in parallel, see connected_components.h.
+ *
  * Developper : Gabriel Bathie (07/2018)
  * */
 
 
-#include <iostream>
-#include <queue>
+#include "connected_components.h"
+#include "parallel.h"
+#include <stdint.h>
+#include <algorithm>
 #include "mex.h"
 
-struct Point
-{
-	int x, y;
-	Point(int a, int b)
-	{ 
-		x = a;
-		y = b;
-	}
-	
-	std::vector<Point> neighbors(int w, int h)
-	{
-		std::vector<Point> res;
-		if (x > 0)
-		{
-			res.push_back(Point(x-1,y));
-		}
-		if (y > 0)
-		{
-			res.push_back(Point(x,y-1));
-		}
-		if (x+1 < w)
-		{
-			res.push_back(Point(x+1,y));
-		}
-		if (y+1 < h)
-		{
-			res.push_back(Point(x,y+1));
-		}
-		return res;
-	}
-};
-
-double *getConnComp(const double *u, int w, int h)
+// Labels \a idcc of the image \a u, whose pixels are of type T, with their
+// \a stats if \a statistics, and the sums of the K images \a v of any class
+// if not null, \a ok being set to false for an unsupported class of v
+template <typename T>
+void Label(const T* u, int m, int n, int32_t* idcc, bool statistics,
+           const mxArray* v, int K, ComponentStats& stats, bool& ok)
 {
-	std::queue<Point> stack({Point(0,0)});
-	double *res = new double[w*h];
-	int* visited = new int[w*h];
-	for (int i = 0; i < w*h; ++i)
-	{
-		res[i] = 0;
-		visited[i] = 0;
-	}
-	visited[0] = 1;
-	double id = 1.0;
-	int k = 0;
-	while (!stack.empty())
-	{
-		Point cur = stack.front();
-		stack.pop();
-		res[cur.x*h + cur.y] = id;
-		for (auto p : cur.neighbors(w,h))
-		{
-			if ((!visited[p.x*h + p.y]) && (u[p.x*h + p.y] == u[cur.x*h + cur.y]))
-			{					
-				visited[p.x*h + p.y] = 1;
-				stack.push(p);
-			}
-		}
-		
-		// If the stack is empty, we have visited a whole connected component,
-		// Go to the next connected component if there is one
-		if(stack.empty())
-		{
-			id += 1.0;
-			while(visited[k] && k < w*h)
-			{
-				++k;
-			}
-			if (k < w*h)
-			{
-				int y = k%h;
-				stack.push(Point((k-y)/h, y));
-				
-				visited[k] = 1;
-			}
-		}
-	}
-	delete[] visited;
-	return res;
-	
+    ok = true;
+    const int nbThreads = default_threads();
+    if (!statistics) {connected_components(u, m, n, idcc, 1, nbThreads); return;}
+    if (!v) {connected_components(u, m, n, idcc, (const double*)0, 0, stats, 1, nbThreads); return;}
+    switch (mxGetClassID(v)) {
+        case mxUINT8_CLASS : connected_components(u, m, n, idcc, (const uint8_t*)mxGetData(v), K, stats, 1, nbThreads); break;
+        case mxUINT16_CLASS : connected_components(u, m, n, idcc, (const uint16_t*)mxGetData(v), K, stats, 1, nbThreads); break;
+        case mxSINGLE_CLASS : connected_components(u, m, n, idcc, (const float*)mxGetData(v), K, stats, 1, nbThreads); break;
+        case mxDOUBLE_CLASS : connected_components(u, m, n, idcc, (const double*)mxGetData(v), K, stats, 1, nbThreads); break;
+        default: ok = false;
+    }
 }
 
 // Entry point for Matlab
 //
 // Input:
-// u : the image
-// 
+// u : the image, of class uint8, uint16, single or double
+// v (optional): K images of the size of u stacked in a m x n x K array, of
+// class uint8, uint16, single or double, summed on the components
+//
 // Output :
-// idcc : the id of the connected component of each pixel of u
+// idcc : the id of the connected component of each pixel of u, of class
+// int32, the components being numbered from 1 in the order of their first
+// pixel
+// area : number of pixels of each component, of size Nx1
+// box : bounding box of each component, [first row, first column, last row,
+// last column], of size Nx4
+// S : sum of each image of v on each component, of size NxK
+// S2 : sum of the squares of each image of v on each component, of size NxK
+//
+// The statistics are accumulated while the labels are written, so that
+// S(:,k)./area is the mean of image k on the components without any pixel
+// list.
 //
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-    // Ouput : idcc
-    // Input : u
-    double *u, *idcc;
-    
+    // Ouput : idcc, area, box, S, S2
+    // Input : u, v
+
     // Check for proper input
     switch(nrhs) {
         case 1 : //mexPrintf("Good call.\n");
+        case 2 :
             break;
         default: mexErrMsgTxt("Bad number of inputs.\n");
         break;
     }
-    if (nlhs > 1) {mexErrMsgTxt("Too many outputs.\n");}
-    
+    if (nlhs > 5) {mexErrMsgTxt("Too many outputs.\n");}
+    if (nlhs > 3 && nrhs < 2) {mexErrMsgTxt("S and S2 need v.\n");}
+    if (mxGetNumberOfDimensions(prhs[0]) > 2) {mexErrMsgTxt("u should be an image.\n");}
+
     int n,m;
-    
-    // Get input arguments
-    // Note that n0 and n1 are reversed because of row major in C VS column major format in Matlab
-    u=mxGetPr(prhs[0]);
-    
+
     // Size of the image...
     m=mxGetM(prhs[0]); //number of rows
     n=mxGetN(prhs[0]); //number of columns
-    
-    // Create output arguments
-    plhs[0] = mxCreateDoubleMatrix(m,n,mxREAL);
-    idcc=mxGetPr(plhs[0]);
-    
-    double *tmp = getConnComp(u,n,m);
-    for (int i = 0; i < n*m; ++i)
+    if ((double)m*n > 0x7FFFFFFF) {mexErrMsgTxt("Image too large.\n");}
+
+    // Auxiliary images
+    const mxArray* v = (nrhs > 1)? prhs[1]: 0;
+    int K = 0;
+    if (v)
+    {
+        if (mxGetM(v) != (size_t)m || mxGetNumberOfElements(v) % ((size_t)m*n) != 0 || (m*n > 0 && mxGetDimensions(v)[1] != (size_t)n)) {mexErrMsgTxt("v should be of size m x n x K.\n");}
+        K = (m*n > 0)? (int)(mxGetNumberOfElements(v) / ((size_t)m*n)): 0;
+    }
+
+    // Create output arguments, the labels being written directly in it
+    plhs[0] = mxCreateNumericMatrix(m,n,mxINT32_CLASS,mxREAL);
+    int32_t* idcc = (int32_t*)mxGetData(plhs[0]);
+
+    ComponentStats stats;
+    bool ok = true;
+    switch (mxGetClassID(prhs[0])) {
+        case mxUINT8_CLASS : Label((const uint8_t*)mxGetData(prhs[0]), m, n, idcc, nlhs > 1, v, K, stats, ok); break;
+        case mxUINT16_CLASS : Label((const uint16_t*)mxGetData(prhs[0]), m, n, idcc, nlhs > 1, v, K, stats, ok); break;
+        case mxSINGLE_CLASS : Label((const float*)mxGetData(prhs[0]), m, n, idcc, nlhs > 1, v, K, stats, ok); break;
+        case mxDOUBLE_CLASS : Label((const double*)mxGetData(prhs[0]), m, n, idcc, nlhs > 1, v, K, stats, ok); break;
+        default: mexErrMsgTxt("u should be of class uint8, uint16, single or double.\n");
+    }
+    if (!ok) {mexErrMsgTxt("v should be of class uint8, uint16, single or double.\n");}
+
+    const int N = stats.area.size();
+    if (nlhs > 1)
+    {
+        plhs[1] = mxCreateDoubleMatrix(N,1,mxREAL);
+        std::copy(stats.area.begin(), stats.area.end(), mxGetPr(plhs[1]));
+    }
+    if (nlhs > 2)
+    {
+        plhs[2] = mxCreateDoubleMatrix(N,4,mxREAL);
+        double* box = mxGetPr(plhs[2]);
+        for (int i = 0; i < N; ++i)
+        {
+            box[i] = stats.ymin[i] + 1;
+            box[i+N] = stats.xmin[i] + 1;
+            box[i+2*N] = stats.ymax[i] + 1;
+            box[i+3*N] = stats.xmax[i] + 1;
+        }
+    }
+    if (nlhs > 3)
+    {
+        plhs[3] = mxCreateDoubleMatrix(N,K,mxREAL);
+        std::copy(stats.sum.begin(), stats.sum.end(), mxGetPr(plhs[3]));
+    }
+    if (nlhs > 4)
     {
-    	idcc[i] = tmp[i];
+        plhs[4] = mxCreateDoubleMatrix(N,K,mxREAL);
+        std::copy(stats.sum2.begin(), stats.sum2.end(), mxGetPr(plhs[4]));
     }
-    
-    delete[] tmp;    
 }
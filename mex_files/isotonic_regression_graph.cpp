@@ -0,0 +1,220 @@
+#include "isotonic_regression_graph.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+
+// Iterations between two evaluations of the stopping criterion
+static const int CHECK = 10;
+
+// Range [begin,end) of thread t of nbThreads among n elements
+static void share(int n, int t, int nbThreads, int& begin, int& end)
+{
+    begin = (int)((long long)n*t/nbThreads);
+    end = (int)((long long)n*(t+1)/nbThreads);
+}
+
+IsotonicGraph::IsotonicGraph(int n, int m, const int* firstOf, const int* secondOf)
+: n(n), m(m), first(firstOf, firstOf+m), second(secondOf, secondOf+m),
+  start(n+1, 0), split(n, 0), incident(2*(size_t)m)
+{
+    // Out edges then in edges of each node, counted then placed
+    std::vector<int> out(n, 0), in(n, 0);
+    for (int k = 0; k < m; ++k)
+    {
+        out[first[k]]++;
+        in[second[k]]++;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        split[i] = start[i] + out[i];
+        start[i+1] = split[i] + in[i];
+        out[i] = start[i];
+        in[i] = split[i];
+    }
+    for (int k = 0; k < m; ++k)
+    {
+        incident[out[first[k]]++] = k;
+        incident[in[second[k]]++] = k;
+    }
+}
+
+int IsotonicGraph::threads(int nbThreads) const
+{
+    return std::max(1, std::min(nbThreads, m / 4096));
+}
+
+void IsotonicGraph::spread(const double* winv, const double* mu, double* z,
+                           int begin, int end) const
+{
+    for (int i = begin; i < end; ++i)
+    {
+        double s = 0;
+        for (int e = start[i]; e < split[i]; ++e)
+        {
+            s += mu[incident[e]];
+        }
+        for (int e = split[i]; e < start[i+1]; ++e)
+        {
+            s -= mu[incident[e]];
+        }
+        z[i] = winv[i]*s;
+    }
+}
+
+double IsotonicGraph::lipschitz(const double* w, double tol, int nbThreads) const
+{
+    if (m == 0)
+    {
+        return 0;
+    }
+    std::vector<double> winv(n), z(n), x(m), y(m);
+    for (int i = 0; i < n; ++i)
+    {
+        winv[i] = 1/w[i];
+    }
+    // Positive start, not orthogonal to the leading eigenvector
+    for (int k = 0; k < m; ++k)
+    {
+        x[k] = 1 + 0.5*std::sin(k + 1.0);
+    }
+    nbThreads = threads(nbThreads);
+    Barrier barrier(nbThreads);
+    std::vector<double> partial(nbThreads);
+    double estimate = 0;
+    parallel_for(nbThreads, nbThreads, [&](int t) {
+        int nb, ne, eb, ee;
+        share(n, t, nbThreads, nb, ne);
+        share(m, t, nbThreads, eb, ee);
+        double e = 0, e0 = -1;
+        for (int it = 0; it < 100 && std::fabs(e - e0) > tol*e; ++it)
+        {
+            spread(winv.data(), x.data(), z.data(), nb, ne);
+            barrier.wait();
+            double s = 0;
+            for (int k = eb; k < ee; ++k)
+            {
+                y[k] = z[first[k]] - z[second[k]];
+                s += y[k]*y[k];
+            }
+            partial[t] = s;
+            barrier.wait();
+            e0 = e;
+            e = 0;
+            for (int c = 0; c < nbThreads; ++c)
+            {
+                e += partial[c];
+            }
+            e = std::sqrt(e);
+            if (e == 0)
+            {
+                break;
+            }
+            for (int k = eb; k < ee; ++k)
+            {
+                x[k] = y[k]/e;
+            }
+            barrier.wait();
+        }
+        if (t == 0)
+        {
+            estimate = e;
+        }
+    });
+    return estimate;
+}
+
+int IsotonicGraph::solve(const double* w, const double* beta, double eps,
+                         double* alpha, int maxIt, double tol, int nbThreads,
+                         double* lambda) const
+{
+    std::vector<double> winv(n), z(n);
+    double sw = 0, lo = 0, hi = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        winv[i] = 1/w[i];
+        sw += w[i];
+        lo = (i == 0)? beta[i]: std::min(lo, beta[i]);
+        hi = (i == 0)? beta[i]: std::max(hi, beta[i]);
+    }
+    // A beta - eps, and the dual variables at the extrapolated point mu and
+    // at the last iterate
+    std::vector<double> ab(m), mu(m, 0), prev(m, 0);
+    for (int k = 0; k < m; ++k)
+    {
+        ab[k] = beta[first[k]] - beta[second[k]] - eps;
+    }
+    const double L = 1.2*lipschitz(w, 1e-4, nbThreads);
+    const double step = (L > 0)? 1/L: 0;
+    // Stopping thresholds on the violation of the constraints and on the gap
+    const double range = (hi > lo)? hi - lo: 1;
+    const double maxViolation = tol*range;
+    const double maxGap = sw*maxViolation*maxViolation/2;
+
+    nbThreads = threads(nbThreads);
+    Barrier barrier(nbThreads);
+    std::vector<double> gapOf(nbThreads), violationOf(nbThreads);
+    int iterations = 0;
+    parallel_for(nbThreads, nbThreads, [&](int t) {
+        int nb, ne, eb, ee;
+        share(n, t, nbThreads, nb, ne);
+        share(m, t, nbThreads, eb, ee);
+        int it = 0;
+        while (it < maxIt && step > 0)
+        {
+            // Projected gradient step from mu, then extrapolation
+            spread(winv.data(), mu.data(), z.data(), nb, ne);
+            barrier.wait();
+            for (int k = eb; k < ee; ++k)
+            {
+                const double g = ab[k] - (z[first[k]] - z[second[k]]);
+                const double l = std::min(0.0, mu[k] + step*g);
+                mu[k] = l + 0.99*(l - prev[k]);
+                prev[k] = l;
+            }
+            barrier.wait();
+            ++it;
+            if (tol <= 0 || (it % CHECK != 0 && it != maxIt))
+            {
+                continue;
+            }
+            // Duality gap -lambda'(A alpha - eps) of alpha = beta-W^-1 A' lambda,
+            // and violation of its constraints
+            spread(winv.data(), prev.data(), z.data(), nb, ne);
+            barrier.wait();
+            double gap = 0, violation = 0;
+            for (int k = eb; k < ee; ++k)
+            {
+                const double r = ab[k] - (z[first[k]] - z[second[k]]);
+                gap -= prev[k]*r;
+                violation = std::max(violation, -r);
+            }
+            gapOf[t] = gap;
+            violationOf[t] = violation;
+            barrier.wait();
+            gap = violation = 0;
+            for (int c = 0; c < nbThreads; ++c)
+            {
+                gap += gapOf[c];
+                violation = std::max(violation, violationOf[c]);
+            }
+            if (std::fabs(gap) <= maxGap && violation <= maxViolation)
+            {
+                break;
+            }
+        }
+        spread(winv.data(), prev.data(), z.data(), nb, ne);
+        for (int i = nb; i < ne; ++i)
+        {
+            alpha[i] = beta[i] - z[i];
+        }
+        if (t == 0)
+        {
+            iterations = it;
+        }
+    });
+    if (lambda)
+    {
+        std::copy(prev.begin(), prev.end(), lambda);
+    }
+    return iterations;
+}
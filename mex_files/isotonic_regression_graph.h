@@ -0,0 +1,54 @@
+#ifndef ISOTONIC_REGRESSION_GRAPH_H
+#define ISOTONIC_REGRESSION_GRAPH_H
+
+#include <vector>
+
+// Isotonic regression on a directed graph, the constraints of SNR_local2:
+// min ||W^{1/2}(alpha-beta)||_2 s.t. A alpha >= eps, edge k of A stating
+// alpha[first[k]] - alpha[second[k]] >= eps. The graph may have cycles, so
+// that the dynamic programming of IsotonicTree does not apply, and it is
+// solved by the accelerated projected gradient on the dual of
+// isotonic_regression_iterative.m.
+//
+// The edges are stored as their two ends, for A lambda, and the nodes as the
+// CSR list of their incident edges, for A' mu. An iteration is a sweep of the
+// nodes then of the edges, each split between the threads.
+class IsotonicGraph
+{
+public:
+    /// Graph of \a n nodes and \a m edges first[k] -> second[k], numbered
+    /// from 0.
+    IsotonicGraph(int n, int m, const int* first, const int* second);
+    int size() const { return n; }
+    int edges() const { return m; }
+
+    /// Largest eigenvalue of A W^-1 A', Lipschitz constant of the gradient
+    /// of the dual, by power iteration up to the relative precision \a tol.
+    double lipschitz(const double* w, double tol = 1e-4, int nbThreads = 1) const;
+
+    /// Solve with weights \a w and data \a beta of the nodes, setting the
+    /// nodes \a alpha and, if not null, the dual variables \a lambda <= 0 of
+    /// the edges. At most \a maxIt iterations are done, and fewer if \a tol is
+    /// positive: the iterations stop once the constraints are violated by at
+    /// most tol*R and the duality gap is at most sum(w)*(tol*R)^2/2, R being
+    /// the range of beta, so that the root mean square error of alpha is of the
+    /// order of tol*R. Returns the number of iterations.
+    int solve(const double* w, const double* beta, double eps, double* alpha,
+              int maxIt, double tol = 0, int nbThreads = 1,
+              double* lambda = 0) const;
+
+private:
+    // Threads used on the graph, one per 4096 edges at most
+    int threads(int nbThreads) const;
+    // z = W^-1 A' mu on the nodes [begin,end)
+    void spread(const double* winv, const double* mu, double* z,
+                int begin, int end) const;
+
+    int n, m;
+    std::vector<int> first, second; // Ends of the edges
+    std::vector<int> start; // Incident edges of node i: out edges from
+    std::vector<int> split; // start[i] to split[i], in edges from split[i]
+    std::vector<int> incident; // to start[i+1]
+};
+
+#endif
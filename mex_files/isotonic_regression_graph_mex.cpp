@@ -0,0 +1,84 @@
+#include "isotonic_regression_graph.h"
+#include "parallel.h"
+#include <vector>
+#include "mex.h"
+
+// Entry point for Matlab
+//
+// Native version of isotonic_regression_iterative.m, the solver of
+// SNR_local2, on all the cores. The matrix A is given by the list of its
+// edges and the fixed number of iterations is replaced by a stopping
+// criterion on the duality gap.
+//
+// Input:
+// E: edges of size Mx2, E(k,:)=[i,j] meaning alpha(i)-alpha(j)>=eps, that is
+// A(k,i)=1 and A(k,j)=-1
+// w: weights of the N nodes, of size Nx1
+// beta: data of the nodes, of size Nx1
+// eps: nonnegative real
+// nit: maximal number of iterations
+// tol (optional): the iterations stop once the constraints are violated by
+// at most tol*R and the duality gap is at most sum(w)*(tol*R)^2/2, R being
+// the range of beta. 0 runs the nit iterations. Default 1e-4.
+//
+// Output:
+// alpha: primal variable, of size Nx1
+// lambda: dual variable, of size Mx1
+// it: number of iterations done
+//
+void mexFunction( int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // Ouput : alpha, lambda, it
+    // Input : E, w, beta, eps, nit, tol
+    
+    // Check for proper input
+    double tol = 1e-4;
+    switch(nrhs) {
+        case 5 :
+            break;
+        case 6 :
+            tol = mxGetScalar(prhs[5]);
+            break;
+        default: mexErrMsgTxt("Bad number of inputs.\n");
+        break;
+    }
+    if (nlhs > 3) {mexErrMsgTxt("Too many outputs.\n");}
+    
+    const int n = mxGetNumberOfElements(prhs[2]);
+    const int m = mxGetM(prhs[0]);
+    if (mxGetNumberOfElements(prhs[1]) != (size_t)n) {mexErrMsgTxt("w should be of the size of beta.\n");}
+    if (m > 0 && mxGetN(prhs[0]) != 2) {mexErrMsgTxt("E should be of size Mx2.\n");}
+    if (!mxIsDouble(prhs[0]) || !mxIsDouble(prhs[1]) || !mxIsDouble(prhs[2])) {mexErrMsgTxt("E, w and beta should be of class double.\n");}
+    const double* E = mxGetPr(prhs[0]);
+    const double* w = mxGetPr(prhs[1]);
+    const double* beta = mxGetPr(prhs[2]);
+    const double eps = mxGetScalar(prhs[3]);
+    const int nit = (int)mxGetScalar(prhs[4]);
+    
+    std::vector<int> first(m), second(m);
+    for (int k = 0; k < m; ++k)
+    {
+        if (!(E[k] >= 1 && E[k] <= n && E[k+m] >= 1 && E[k+m] <= n)) {mexErrMsgTxt("E should contain nodes between 1 and N.\n");}
+        first[k] = int(E[k])-1;
+        second[k] = int(E[k+m])-1;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        if (!(w[i] > 0)) {mexErrMsgTxt("w should be positive.\n");}
+    }
+    
+    plhs[0] = mxCreateDoubleMatrix(n,1,mxREAL);
+    std::vector<double> lambda(m);
+    const IsotonicGraph graph(n, m, first.data(), second.data());
+    const int it = graph.solve(w, beta, eps, mxGetPr(plhs[0]), nit, tol,
+                               default_threads(), lambda.data());
+    
+    if (nlhs > 1)
+    {
+        plhs[1] = mxCreateDoubleMatrix(m,1,mxREAL);
+        std::copy(lambda.begin(), lambda.end(), mxGetPr(plhs[1]));
+    }
+    if (nlhs > 2)
+    {
+        plhs[2] = mxCreateDoubleScalar(it);
+    }
+}
@@ -1,4 +1,7 @@
 #include "isotonic_regression_tree.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
 
 // FUNCTIONS ASSOCIATED TO STRUCT NODE
 Node::Node(int s, int i, double y, double w) : sign(s), x(0), y(y), w(w), id(i) {}
@@ -8,193 +11,892 @@ void Node::addChildren(Node *n)
     children.push_back(n);
 }
 
+// The tree is freed with an explicit stack, since its depth is not bounded
 Node::~Node()
 {
-    for (auto child : children)
+    std::vector<Node*> stack;
+    stack.swap(children);
+    while (!stack.empty())
     {
-        delete child;
+        Node* n = stack.back();
+        stack.pop_back();
+        stack.insert(stack.end(), n->children.begin(), n->children.end());
+        n->children.clear();
+        delete n;
     }
 }
 
 void Node::print(int k)
 {
-    for (int i = 0; i < k; ++i)
+    std::vector< std::pair<Node*,int> > stack(1, std::make_pair(this, k));
+    while (!stack.empty())
     {
-        std::cout << "\t";
+        Node* n = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        for (int i = 0; i < depth; ++i)
+        {
+            std::cout << "\t";
+        }
+        std::cout << "s : "<< n->sign << " -- x : " << n->x  << ", y : " << n->y << " -- w : " << n->w << std::endl;
+        for (auto c = n->children.rbegin(); c != n->children.rend(); ++c)
+        {
+            stack.push_back(std::make_pair(*c, depth+1));
+        }
     }
-    std::cout << "s : "<< sign << " -- x : " << x  << ", y : " << y << " -- w : " << w << std::endl;
-    for (auto c : children)
+}
+
+// FUNCTIONS ASSOCIATED TO CLASS BREAKPOINTHEAP
+int BreakpointHeap::add(double x, double s)
+{
+    Breakpoint p;
+    p.x = x;
+    p.s = s;
+    for (int d = 0; d < 2; ++d)
     {
-        c->print(k+1);
+        p.left[d] = p.right[d] = -1;
+        p.rank[d] = 1;
     }
+    p.dead = false;
+    pts.push_back(p);
+    return (int)pts.size()-1;
 }
 
-// FUNCTIONS ASSOCIATED TO CLASS MESSAGE
-Message::Message(int l, double* b, double* s, double sm, double ym, double sp, double yp)
-: am(sm), bm(ym), ap(sp), bp(yp)
+int BreakpointHeap::merge(int d, int h1, int h2)
 {
-    breakpoints.clear();
-    slope.clear();
-    for (int i = 0; i < l; i++)
+    if (h1 < 0) return h2;
+    if (h2 < 0) return h1;
+    if (before(d, h2, h1)) std::swap(h1, h2);
+    Breakpoint& q = pts[h2];
+    if (tolerance >= 0 && !pts[h1].dead && !q.dead &&
+        std::abs(q.x - pts[h1].x) <= tolerance)
     {
-        breakpoints.push_back(b[i]);
-        slope.push_back(s[i]);
+        // h2 is added to h1, and removed from this heap
+        pts[h1].s += q.s;
+        q.dead = true;
+        coalesced++;
+        return merge(d, h1, merge(d, q.left[d], q.right[d]));
     }
+    // The right spine of a leftist heap has O(log n) nodes
+    int r = merge(d, pts[h1].right[d], h2);
+    Breakpoint& p = pts[h1];
+    p.right[d] = r;
+    if (rank(d, p.left[d]) < rank(d, p.right[d]))
+        std::swap(p.left[d], p.right[d]);
+    p.rank[d] = rank(d, p.right[d]) + 1;
+    return h1;
 }
 
-void Message::print()
+int BreakpointHeap::top(int d, int& h)
 {
-    using namespace std;
-    cout << "Message" << endl;
-    for (int i = 0; i < length(); i++)
+    while (pts[h].dead)
+        h = merge(d, pts[h].left[d], pts[h].right[d]);
+    return h;
+}
+
+void BreakpointHeap::pop(int d, int& h)
+{
+    int t = top(d, h);
+    pts[t].dead = true;
+    h = merge(d, pts[t].left[d], pts[t].right[d]);
+}
+
+Message BreakpointHeap::import(const BreakpointHeap& h, Message m)
+{
+    const int offset = (int)pts.size();
+    pts.insert(pts.end(), h.pts.begin(), h.pts.end());
+    for (size_t i = offset; i < pts.size(); ++i)
     {
-        cout << breakpoints[i] << " ";
+        for (int d = 0; d < 2; ++d)
+        {
+            if (pts[i].left[d] >= 0) pts[i].left[d] += offset;
+            if (pts[i].right[d] >= 0) pts[i].right[d] += offset;
+        }
+    }
+    for (int d = 0; d < 2; ++d)
+    {
+        if (m.heap[d] >= 0) m.heap[d] += offset;
     }
-    cout << endl;
-    for (int i = 0; i < length(); i++)
+    return m;
+}
+
+void BreakpointHeap::chain(int first, int last)
+{
+    // A sorted list is a leftist heap of rank 1 in each direction
+    for (int i = first; i <= last; ++i)
     {
-        cout << slope[i] << " ";
+        pts[i].left[0] = (i < last)? i+1: -1;
+        pts[i].left[1] = (i > first)? i-1: -1;
     }
-    cout << endl;
-    cout << " am, bm, " << am << ", " << bm << endl;
-    cout << " ap, bp, " << ap << ", " << bp << endl;
-    
 }
 
 // MAIN CODE 
-Message fusion(Message& m1, const Message& m2)
+// Add the message m2 to m1, m2 being left empty
+void fusion(Message& m1, Message& m2, BreakpointHeap& heap)
 {
-    Message res;
-    res.am = m1.am + m2.am;
-    res.bm = m1.bm + m2.bm;
-    res.ap = m1.ap + m2.ap;
-    res.bp = m1.bp + m2.bp;
-    int i = 0, j = 0;
-    for (i=0, j=0; i < m1.length() && j < m2.length();)
+    m1.am += m2.am;
+    m1.bm += m2.bm;
+    m1.ap += m2.ap;
+    m1.bp += m2.bp;
+    const size_t coalesced = heap.count();
+    for (int d = 0; d < 2; ++d)
+    {
+        m1.heap[d] = heap.merge(d, m1.heap[d], m2.heap[d]);
+    }
+    m1.n += m2.n - (int)(heap.count() - coalesced);
+    m2 = Message();
+}
+
+// FUNCTIONS ASSOCIATED TO CLASS ISOTONICTREE
+IsotonicTree::IsotonicTree(int n, const int* parentOf, const int* signOf, double tolerance)
+: tolerance(tolerance)
+{
+    // Children of each node in CSR form, by increasing index
+    std::vector<int> first(n+1, 0), child(n);
+    for (int i = 0; i < n; ++i)
+    {
+        if (parentOf[i] >= 0) first[parentOf[i]+1]++;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        first[i+1] += first[i];
+    }
+    std::vector<int> next(first.begin(), first.end()-1);
+    for (int i = 0; i < n; ++i)
+    {
+        if (parentOf[i] >= 0) child[next[parentOf[i]]++] = i;
+    }
+
+    // Depth-first order with an explicit stack, roots by increasing index
+    std::vector<int> stack, position(n, -1);
+    order.reserve(n);
+    for (int r = n-1; r >= 0; --r)
+    {
+        if (parentOf[r] < 0) stack.push_back(r);
+    }
+    while (!stack.empty())
+    {
+        int i = stack.back();
+        stack.pop_back();
+        position[i] = (int)order.size();
+        order.push_back(i);
+        for (int c = first[i+1]-1; c >= first[i]; --c)
+        {
+            stack.push_back(child[c]);
+        }
+    }
+
+    const int m = (int)order.size();
+    parent.resize(m);
+    sign.resize(m);
+    subtree.assign(m, 1);
+    for (int p = 0; p < m; ++p)
+    {
+        int i = order[p];
+        parent[p] = (parentOf[i] >= 0)? position[parentOf[i]]: -1;
+        sign[p] = signOf[i];
+    }
+    for (int p = m-1; p >= 0; --p)
+    {
+        if (parent[p] >= 0) subtree[parent[p]] += subtree[p];
+    }
+}
+
+// Breakpoints added along a chain, below (low) and above (high) those of the
+// heap of its message. Each inf-convolution pops breakpoints from one end of
+// the message and adds one at this end, which is a stack-based PAVA when the
+// signs agree: the vectors do it in O(1), the heap being only popped once its
+// ends are exhausted. From their first live element to their back, the
+// breakpoints of low decrease and those of high increase. IsotonicSolver
+// replaces the heap by the sorted breakpoints mid. A new breakpoint close
+// enough to the one at its end is coalesced with it.
+struct IsotonicTree::Ends
+{
+    struct Point
+    {
+        double x, s;
+        bool operator<(const Point& p) const {return x < p.x;}
+    };
+    std::vector<Point> low, high, mid, buffer;
+    size_t lowBegin, highBegin, midBegin, midEnd;
+    int inHeap;     // live breakpoints in the heap of the message
+    double tolerance;
+    size_t coalesced, total, largest; // see IsotonicStats
+
+    Ends(double tolerance): tolerance(tolerance), coalesced(0), total(0), largest(0)
+    {
+        reset(0);
+    }
+
+    // Add the counters of the ends and of heap to stats
+    void count(const BreakpointHeap& heap, IsotonicStats& stats) const
+    {
+        stats.coalesced += coalesced + heap.count();
+        stats.total += total;
+        stats.largest = std::max(stats.largest, largest);
+    }
+
+    // Count the breakpoints coalesced in the heap since it had c of them
+    void settle(Message& m, BreakpointHeap& heap, size_t c)
+    {
+        int k = (int)(heap.count() - c);
+        m.n -= k;
+        inHeap -= k;
+    }
+
+    void reset(int n)
+    {
+        low.clear();
+        high.clear();
+        mid.clear();
+        lowBegin = highBegin = midBegin = midEnd = 0;
+        inHeap = n;
+    }
+
+    // First breakpoint from the min (0) or max (1) end of the message m
+    Point front(int d, Message& m, BreakpointHeap& heap)
     {
-        if (m1.breakpoints[i] < m2.breakpoints[j])
+        std::vector<Point>& near = d == 0? low: high;
+        std::vector<Point>& far = d == 0? high: low;
+        if (near.size() > (d == 0? lowBegin: highBegin))
+            return near.back();
+        if (inHeap > 0)
         {
-            res.breakpoints.push_back(m1.breakpoints[i]);
-            res.slope.push_back(m1.slope[i]);
-            ++i;
+            size_t c = heap.count();
+            int i = heap.top(d, m.heap[d]);
+            settle(m, heap, c);
+            Point p = {heap.x(i), heap.slope(i)};
+            return p;
+        }
+        if (midBegin < midEnd)
+            return d == 0? mid[midBegin]: mid[midEnd-1];
+        return far[d == 0? highBegin: lowBegin];
+    }
+
+    void pop(int d, Message& m, BreakpointHeap& heap)
+    {
+        std::vector<Point>& near = d == 0? low: high;
+        std::vector<Point>& far = d == 0? high: low;
+        size_t& nearBegin = d == 0? lowBegin: highBegin;
+        size_t& farBegin = d == 0? highBegin: lowBegin;
+        if (near.size() > nearBegin)
+        {
+            near.pop_back();
+            if (near.size() == nearBegin) {near.clear(); nearBegin = 0;}
+        }
+        else if (inHeap > 0)
+        {
+            size_t c = heap.count();
+            heap.pop(d, m.heap[d]);
+            settle(m, heap, c);
+            inHeap--;
+        }
+        else if (midBegin < midEnd)
+        {
+            if (d == 0) ++midBegin; else --midEnd;
+        }
+        else if (++farBegin == far.size())
+        {
+            far.clear();
+            farBegin = 0;
+        }
+        m.n--;
+    }
+
+    /* Given a message m (describing a nondecreasing piecewise linear function f) and a sign s, this function
+     * stores the result of the inf-convolution g defined for all y by:
+     * g(y) = inf_{x, s*(x-y)>=0} f(x)
+     * */
+    double infConvolution(Message &m, int s, BreakpointHeap& heap)
+    {
+        double x = 0;
+        double a, b = 0;
+
+        if (s >= 0) // must be larger than  parent
+        {
+            a = m.am; b = m.bm;
+            while(m.length() > 0)
+            {
+                Point p = front(0, m, heap);
+                if (!(a*p.x+b < 0))
+                    break;
+
+                a += p.s;
+                b += -p.x*p.s;
+                pop(0, m, heap);
+            }
+            x = -b/a;
+            Point p = {x, a};
+            push(low, lowBegin, p, m);
+            m.am = 0;
+            m.bm = 0;
         }
         else
         {
-            res.breakpoints.push_back(m2.breakpoints[j]);
-            res.slope.push_back(m2.slope[j]);
-            ++j;
+            a = m.ap; b = m.bp;
+            while(m.length() > 0)
+            {
+                Point p = front(1, m, heap);
+                if (!(a*p.x+b > 0))
+                    break;
+
+                a -= p.s;
+                b -= -p.x*p.s;
+                pop(1, m, heap);
+            }
+            x = -b/a;
+            Point p = {x, -a};
+            push(high, highBegin, p, m);
+            m.ap = 0;
+            m.bp = 0;
         }
-        // Beware, we do not treat the case where the x-coord of the breakpoints are equal
+        return x;
     }
-    for (;i < m1.length(); ++i)
+
+    // Add p at the back of near, whose first live element is begin
+    void push(std::vector<Point>& near, size_t begin, const Point& p, Message& m)
     {
-        res.breakpoints.push_back(m1.breakpoints[i]);
-        res.slope.push_back(m1.slope[i]);
+        if (tolerance >= 0 && near.size() > begin &&
+            std::abs(near.back().x - p.x) <= tolerance)
+        {
+            near.back().s += p.s;
+            coalesced++;
+            return;
+        }
+        near.push_back(p);
+        m.n++;
     }
-    for (;j < m2.length(); ++j)
+
+    // Add p at the back of the sorted breakpoints of buffer
+    void append(const Point& p, Message& m)
     {
-        res.breakpoints.push_back(m2.breakpoints[j]);
-        res.slope.push_back(m2.slope[j]);
+        if (tolerance >= 0 && !buffer.empty() &&
+            std::abs(buffer.back().x - p.x) <= tolerance)
+        {
+            buffer.back().s += p.s;
+            coalesced++;
+            m.n--;
+            return;
+        }
+        buffer.push_back(p);
     }
-    
-    return res;
+
+    // Coefficients of m then its breakpoints by increasing x, as pairs of x
+    // and slope delta, in out. The heap is left to be cleared.
+    void extract(Message& m, BreakpointHeap& heap, std::vector<double>& out)
+    {
+        const size_t size = 4 + 2*(size_t)m.n;
+        if (out.capacity() < size)
+            std::vector<double>(size).swap(out); // without spare capacity
+        else
+            out.resize(size);
+        double* o = &out[0];
+        *o++ = m.am;
+        *o++ = m.bm;
+        *o++ = m.ap;
+        *o++ = m.bp;
+        for (size_t i = low.size(); i-- > lowBegin;)
+        {
+            *o++ = low[i].x;
+            *o++ = low[i].s;
+        }
+        while (inHeap > 0)
+        {
+            size_t c = heap.count();
+            int i = heap.top(0, m.heap[0]);
+            *o++ = heap.x(i);
+            *o++ = heap.slope(i);
+            heap.pop(0, m.heap[0]);
+            settle(m, heap, c);
+            inHeap--;
+        }
+        for (size_t i = midBegin; i < midEnd; ++i)
+        {
+            *o++ = mid[i].x;
+            *o++ = mid[i].s;
+        }
+        for (size_t i = highBegin; i < high.size(); ++i)
+        {
+            *o++ = high[i].x;
+            *o++ = high[i].s;
+        }
+        out.resize(o - &out[0]); // less if breakpoints of the heap were coalesced
+        reset(0);
+    }
+
+    // Move the breakpoints of the ends to the heap of m, as one sorted list
+    void splice(Message& m, BreakpointHeap& heap)
+    {
+        buffer.clear();
+        for (size_t i = low.size(); i-- > lowBegin;)
+        {
+            append(low[i], m);
+        }
+        for (size_t i = highBegin; i < high.size(); ++i)
+        {
+            append(high[i], m);
+        }
+        if (!buffer.empty())
+        {
+            int first = heap.add(buffer[0].x, buffer[0].s), last = first;
+            for (size_t i = 1; i < buffer.size(); ++i)
+            {
+                last = heap.add(buffer[i].x, buffer[i].s);
+            }
+            heap.chain(first, last);
+            size_t c = heap.count();
+            m.heap[0] = heap.merge(0, m.heap[0], first);
+            m.heap[1] = heap.merge(1, m.heap[1], last);
+            m.n -= (int)(heap.count() - c);
+        }
+        reset(0);
+    }
+};
+
+// Upward steps from position p, whose message mp is the sum of those of its
+// children, with breakpoints in the heap or in e: the quadratic unary of its
+// node is added, then the message is inf-convolved. The steps go on up the
+// chain of ancestors having one child, down to position first at most, whose
+// position is returned.
+int IsotonicTree::walk(int p, int first, const double* w, const double* y, double* v,
+                       Message& mp, BreakpointHeap& heap, Ends& e) const
+{
+    for (;;)
+    {
+        int i = order[p];
+        // Add the offset from the quadratic unary.
+        mp.am += w[i];
+        mp.bm -= w[i]*y[i];
+        mp.ap += w[i];
+        mp.bp -= w[i]*y[i];
+        // Then return the min convolution of the message
+        v[p] = e.infConvolution(mp, sign[p], heap);
+        e.total += mp.n;
+        e.largest = std::max(e.largest, (size_t)mp.n);
+        if (p == first || parent[p] != p-1 || subtree[p-1] != subtree[p]+1)
+            break;
+        --p;
+    }
+    return p;
 }
 
-/* Given a message m (describing a nondecreasing piecewise linear function f) and a sign s, this function
- * stores the result of the inf-convolution g defined for all y by:
- * g(y) = inf_{x, s*(x-y)>=0} f(x)
- * */
-double infConvolution(Message &m, int s)
+// Upward steps from position p, its children being fused in order, up to the
+// top of its chain, whose message is set and position returned.
+int IsotonicTree::up(int p, int first, const double* w, const double* y, double* v,
+                     Message* m, BreakpointHeap& heap, Ends& e) const
 {
-    double x = 0;
-    double a, b = 0;
-    
-    if (s >= 0) // must be larger than  parent
+    Message mp;
+    for (int c = p+1; c < p+subtree[p]; c += subtree[c])
     {
-        a = m.am; b = m.bm;
-        while(m.length() > 0 && a*m.breakpoints.front()+b < 0)
+        fusion(mp, m[c], heap);
+    }
+    e.reset(mp.n);
+    p = walk(p, first, w, y, v, mp, heap, e);
+    e.splice(mp, heap);
+    m[p] = mp;
+    return p;
+}
+
+// Downward step at position p: its value is clipped by that of its parent.
+void IsotonicTree::down(int p, double* v) const
+{
+    int q = parent[p];
+    if (q >= 0 && sign[p]*(v[p]-v[q]) <= 0)
+        v[p] = v[q];
+}
+
+// Smallest subtree solved as a task by the parallel version
+static const int MIN_TASK = 1024;
+
+void IsotonicTree::solve(const double* w, const double* y, double* x, int nbThreads,
+                         IsotonicStats* stats) const
+{
+    const int n = size();
+    if (n == 0) return;
+    std::vector<double> v(n); // values by position
+    std::vector<Message> m(n); // messages of the subtrees by position
+    BreakpointHeap heap(tolerance);
+    IsotonicStats counts;
+    counts.added = n;
+
+    // Largest disjoint subtrees of at most n/(4*nbThreads) nodes, extended to
+    // the top of their chain, roots excluded, by position. Smaller subtrees
+    // than MIN_TASK are left to the sequential part.
+    std::vector<int> tasks;
+    if (nbThreads > 1)
+    {
+        const int maxSize = std::max(MIN_TASK, n / (4*nbThreads));
+        for (int p = 0; p < n; ++p)
         {
-            double tmp_s = m.slope.front();
-            
-            a += tmp_s;
-            m.slope.pop_front();
-            
-            b += -m.breakpoints.front()*tmp_s;
-            m.breakpoints.pop_front();
+            if (subtree[p] < MIN_TASK || subtree[p] > maxSize ||
+                parent[p] < 0 || subtree[parent[p]] <= maxSize)
+                continue;
+            // Top of its chain, which is solved as a whole
+            int r = p;
+            while (parent[r] >= 0 && subtree[parent[r]] == subtree[r]+1)
+                r = parent[r];
+            if (parent[r] >= 0)
+                tasks.push_back(r);
         }
-        x = -b/a;
-        m.breakpoints.push_front(x);
-        m.slope.push_front(a);
-        m.am = 0;
-        m.bm = 0;
     }
-    else
+    const int nbTasks = (int)tasks.size();
+    if (nbTasks > 0)
     {
-        a = m.ap; b = m.bp;
-        while(m.length() > 0 && a*m.breakpoints.back()+b > 0)
+        // Largest subtrees first, each on its own heap, whose shape does not
+        // depend on the indices of breakpoints: once imported, they are
+        // merged as in the sequential version.
+        std::vector< std::pair<int,int> > bySize(nbTasks);
+        for (int t = 0; t < nbTasks; ++t)
+        {
+            bySize[t] = std::make_pair(-subtree[tasks[t]], tasks[t]);
+        }
+        std::sort(bySize.begin(), bySize.end());
+        std::vector<BreakpointHeap> heaps(nbTasks, BreakpointHeap(tolerance));
+        std::vector<IsotonicStats> taskCounts(nbTasks);
+        parallel_for(nbTasks, nbThreads, [&](int t) {
+            int r = bySize[t].second;
+            Ends e(tolerance);
+            for (int p = r+subtree[r]-1; p >= r; --p)
+                p = up(p, r, w, y, &v[0], &m[0], heaps[t], e);
+            e.count(heaps[t], taskCounts[t]);
+        });
+        for (int t = 0; t < nbTasks; ++t)
         {
-            double tmp_s = m.slope.back();
-            
-            a -= tmp_s;
-            m.slope.pop_back();
-            
-            b -= -m.breakpoints.back()*tmp_s;
-            m.breakpoints.pop_back();
+            int r = bySize[t].second;
+            m[r] = heap.import(heaps[t], m[r]);
+            heaps[t] = BreakpointHeap();
+            counts.coalesced += taskCounts[t].coalesced;
+            counts.total += taskCounts[t].total;
+            counts.largest = std::max(counts.largest, taskCounts[t].largest);
         }
-        x = -b/a;
-        m.breakpoints.push_back(x);
-        m.slope.push_back(-a);
-        m.ap = 0;
-        m.bp = 0;
     }
-    return x;
+
+    // Upward pass in reverse depth-first order, so that children come before
+    // their parent, skipping the subtrees already solved. Tasks being tops of
+    // chains, the chains are the same as in the sequential version.
+    Ends e(tolerance);
+    int k = nbTasks-1;
+    for (int p = n-1; p >= 0; --p)
+    {
+        if (k >= 0 && p == tasks[k]+subtree[tasks[k]]-1)
+        {
+            p = tasks[k--];
+            continue;
+        }
+        p = up(p, 0, w, y, &v[0], &m[0], heap, e);
+    }
+    std::vector<Message>().swap(m);
+    e.count(heap, counts);
+    if (stats)
+    {
+        stats->added += counts.added;
+        stats->coalesced += counts.coalesced;
+        stats->total += counts.total;
+        stats->largest = std::max(stats->largest, counts.largest);
+    }
+
+    // Downward pass in depth-first order, then inside the subtrees
+    k = 0;
+    for (int p = 0; p < n; ++p)
+    {
+        down(p, &v[0]);
+        if (k < nbTasks && p == tasks[k])
+            p += subtree[tasks[k++]]-1;
+    }
+    if (nbTasks > 0)
+    {
+        parallel_for(nbTasks, nbThreads, [&](int t) {
+            int r = tasks[t];
+            for (int p = r+1; p < r+subtree[r]; ++p)
+                down(p, &v[0]);
+        });
+    }
+    for (int p = 0; p < n; ++p)
+    {
+        x[order[p]] = v[p];
+    }
 }
 
-Message searchNode(Node *root)
+// FUNCTIONS ASSOCIATED TO CLASS ISOTONICSOLVER
+IsotonicSolver::IsotonicSolver(const IsotonicTree& t)
+: tree(t), position(t.size()), top(t.size()), w(t.size()), y(t.size()),
+  raw(t.size()), value(t.size()), message(t.size()), isDirty(t.size(), 0)
 {
-    Message m;
-    for (auto child : root->children) // Sum the messages of the children (inf-convolutions)
+    const int n = tree.size();
+    for (int p = 0; p < n; ++p)
     {
-        m = fusion(m, searchNode(child));
+        position[tree.order[p]] = p;
+        int q = tree.parent[p];
+        top[p] = (q == p-1 && q >= 0 && tree.subtree[q] == tree.subtree[p]+1)? top[q]: p;
     }
-    // Add the offset from the quadratic unary.
-    m.am += root->w;
-    m.bm -= root->w*root->y;
-    m.ap += root->w;
-    m.bp -= root->w*root->y;
-    // Then return the min convolution of the message
-    root->x = infConvolution(m, root->sign);
-    return m;
 }
 
-void backprop(Node *root, double y)
+// Solve the chain whose bottom is position b, from the stored messages of
+// the children of b, storing the message of its top, which is returned. The
+// sorted breakpoints of the children are merged without the heap.
+int IsotonicSolver::chain(int b, IsotonicTree::Ends& e)
+{
+    typedef IsotonicTree::Ends::Point Point;
+    Message mp;
+    std::vector<size_t> runs(1, 0);
+    e.reset(0);
+    for (int c = b+1; c < b+tree.subtree[b]; c += tree.subtree[c])
+    {
+        runs.push_back(runs.back() + (message[c].size()-4)/2);
+    }
+    e.mid.resize(runs.back());
+    Point* o = e.mid.empty()? 0: &e.mid[0];
+    for (int c = b+1; c < b+tree.subtree[b]; c += tree.subtree[c])
+    {
+        const std::vector<double>& s = message[c];
+        mp.am += s[0];
+        mp.bm += s[1];
+        mp.ap += s[2];
+        mp.bp += s[3];
+        for (size_t k = 4; k < s.size(); k += 2, ++o)
+        {
+            o->x = s[k];
+            o->s = s[k+1];
+        }
+    }
+    // Sorted runs merged by pairs, between mid and buffer
+    for (size_t step = 1; step+1 < runs.size(); step *= 2)
+    {
+        e.buffer.resize(e.mid.size());
+        for (size_t r = 0; r < runs.size()-1; r += 2*step)
+        {
+            size_t middle = runs[std::min(r+step, runs.size()-1)];
+            size_t end = runs[std::min(r+2*step, runs.size()-1)];
+            std::merge(e.mid.begin()+runs[r], e.mid.begin()+middle,
+                       e.mid.begin()+middle, e.mid.begin()+end,
+                       e.buffer.begin()+runs[r]);
+        }
+        e.mid.swap(e.buffer);
+    }
+    // Equal breakpoints of the children coalesced
+    size_t kept = 0;
+    for (size_t i = 0; i < e.mid.size(); ++i)
+    {
+        if (kept > 0 && tree.tolerance >= 0 &&
+            std::abs(e.mid[i].x - e.mid[kept-1].x) <= tree.tolerance)
+        {
+            e.mid[kept-1].s += e.mid[i].s;
+            e.coalesced++;
+        }
+        else
+            e.mid[kept++] = e.mid[i];
+    }
+    e.mid.resize(kept);
+    e.midEnd = kept;
+    mp.n = (int)kept;
+    BreakpointHeap heap; // unused, the breakpoints being in e
+    int t = tree.walk(b, 0, &w[0], &y[0], &raw[0], mp, heap, e);
+    std::vector<double>& stored = message[t];
+    e.extract(mp, heap, stored);
+    if (stored.capacity() > 2*stored.size())
+        std::vector<double>(stored).swap(stored);
+    return t;
+}
+
+// Value of position p clipped by that of its parent
+double IsotonicSolver::clip(int p) const
+{
+    int q = tree.parent[p];
+    if (q >= 0 && tree.sign[p]*(raw[p]-value[q]) <= 0)
+        return value[q];
+    return raw[p];
+}
+
+void IsotonicSolver::solve(const double* wi, const double* yi, double* x)
 {
-    int s = root->sign;
-    double x = root->x;
-    if  (s*(x-y) <= 0)
-        root->x = y;
-    for (auto child : root->children)
+    const int n = tree.size();
+    w.assign(wi, wi+n);
+    y.assign(yi, yi+n);
+    IsotonicTree::Ends e(tree.tolerance);
+    for (int p = n-1; p >= 0; --p)
+    {
+        p = chain(p, e);
+    }
+    for (int p = 0; p < n; ++p)
     {
-        backprop(child, root->x);
+        value[p] = clip(p);
+        x[tree.order[p]] = value[p];
     }
-    
+    for (size_t k = 0; k < dirty.size(); ++k)
+    {
+        isDirty[dirty[k]] = 0;
+    }
+    dirty.clear();
 }
 
-void Recursive_Tree_Search(Node &root)
+void IsotonicSolver::update(int i, double wi, double yi)
 {
-    searchNode(&root);
-    for (auto child : root.children)
+    w[i] = wi;
+    y[i] = yi;
+    // The chains of the node and of its ancestors, up to one already marked
+    for (int t = top[position[i]]; t >= 0 && !isDirty[t];)
     {
-        backprop(child, root.x);
+        isDirty[t] = 1;
+        dirty.push_back(t);
+        t = (tree.parent[t] >= 0)? top[tree.parent[t]]: -1;
     }
 }
 
+void IsotonicSolver::resolve(double* x)
+{
+    // Upward pass on the marked chains, descendants first
+    std::sort(dirty.begin(), dirty.end());
+    IsotonicTree::Ends e(tree.tolerance);
+    for (size_t k = dirty.size(); k-- > 0;)
+    {
+        int b = dirty[k];
+        while (tree.subtree[b] > 1 && tree.subtree[b+1] == tree.subtree[b]-1)
+            ++b;
+        chain(b, e);
+    }
+
+    // Downward pass on the marked chains, ancestors first, continued below
+    // them where the value of a chain bottom changed
+    std::vector<int> stack;
+    for (size_t k = 0; k < dirty.size(); ++k)
+    {
+        int p = dirty[k];
+        for (;; ++p)
+        {
+            value[p] = clip(p);
+            x[tree.order[p]] = value[p];
+            if (tree.subtree[p] == 1 || tree.subtree[p+1] != tree.subtree[p]-1)
+                break;
+        }
+        for (int c = p+1; c < p+tree.subtree[p]; c += tree.subtree[c])
+        {
+            if (!isDirty[c]) stack.push_back(c);
+        }
+        while (!stack.empty())
+        {
+            int q = stack.back();
+            stack.pop_back();
+            double v = clip(q);
+            if (v == value[q])
+                continue;
+            value[q] = v;
+            x[tree.order[q]] = v;
+            for (int c = q+1; c < q+tree.subtree[q]; c += tree.subtree[c])
+            {
+                stack.push_back(c);
+            }
+        }
+    }
+    for (size_t k = 0; k < dirty.size(); ++k)
+    {
+        isDirty[dirty[k]] = 0;
+    }
+    dirty.clear();
+}
+
+size_t IsotonicSolver::memory() const
+{
+    size_t bytes = (position.size()+top.size())*sizeof(int) +
+        (w.size()+y.size()+raw.size()+value.size())*sizeof(double) +
+        message.size()*(sizeof(std::vector<double>)+1);
+    for (size_t p = 0; p < message.size(); ++p)
+    {
+        bytes += message[p].capacity()*sizeof(double);
+    }
+    return bytes;
+}
+
+void isotonic_chain(int n, const double* w, const double* y, double* x)
+{
+    // Blocks of pooled nodes, of weight sw and weighted sum swy, the last
+    // node of block b being end[b]-1
+    std::vector<double> sw, swy;
+    std::vector<int> end;
+    for (int i = 0; i < n; ++i)
+    {
+        double bw = w[i], bwy = w[i]*y[i];
+        // Pool while the previous block has a larger mean
+        while (!sw.empty() && swy.back()*bw >= bwy*sw.back())
+        {
+            bw += sw.back();
+            bwy += swy.back();
+            sw.pop_back();
+            swy.pop_back();
+            end.pop_back();
+        }
+        sw.push_back(bw);
+        swy.push_back(bwy);
+        end.push_back(i+1);
+    }
+    for (size_t b = 0, i = 0; b < end.size(); ++b)
+    {
+        const double mean = (sw[b] > 0)? swy[b]/sw[b]: 0;
+        for (; (int)i < end[b]; ++i)
+        {
+            x[i] = mean;
+        }
+    }
+}
+
+void Recursive_Tree_Search(Node &root, int nbThreads)
+{
+    // Nodes in breadth-first order, children being numbered in order
+    std::vector<Node*> nodes(1, &root);
+    std::vector<int> parent(1, -1);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        for (auto child : nodes[i]->children)
+        {
+            nodes.push_back(child);
+            parent.push_back((int)i);
+        }
+    }
+    const int n = (int)nodes.size();
+    std::vector<int> sign(n);
+    std::vector<double> w(n), y(n), x(n);
+    for (int i = 0; i < n; ++i)
+    {
+        sign[i] = nodes[i]->sign;
+        w[i] = nodes[i]->w;
+        y[i] = nodes[i]->y;
+    }
+    IsotonicTree tree(n, &parent[0], &sign[0]);
+    tree.solve(&w[0], &y[0], &x[0], nbThreads);
+    for (int i = 0; i < n; ++i)
+    {
+        nodes[i]->x = x[i];
+    }
+}
+
+// Value of the objective, summed in post-order as the recursive version did
 double score(Node *root)
 {
-    double res = (root->w)*(root->x - root->y)*(root->x - root->y)/2;
-    for (auto child : root->children)
+    struct Frame
+    {
+        Node* node;
+        size_t next;
+        double res;
+    };
+    std::vector<Frame> stack;
+    Frame f = {root, 0, (root->w)*(root->x - root->y)*(root->x - root->y)/2};
+    stack.push_back(f);
+    double res = 0;
+    while (!stack.empty())
     {
-        res += score(child);
+        Frame& top = stack.back();
+        if (top.next < top.node->children.size())
+        {
+            Node* c = top.node->children[top.next++];
+            Frame child = {c, 0, (c->w)*(c->x - c->y)*(c->x - c->y)/2};
+            stack.push_back(child); // Invalidates top
+            continue;
+        }
+        res = top.res;
+        stack.pop_back();
+        if (!stack.empty())
+        {
+            stack.back().res += res;
+        }
     }
     return res;
 }
@@ -2,7 +2,6 @@
 #include "mex.h"
 #include <iostream>
 #include <vector>
-#include <deque>
 
 #define INFTY 1e16
 
@@ -19,18 +18,136 @@ struct Node
     void print(int k = 0);
 };
 
+// Breakpoints of the messages of one regression. Each breakpoint is in a
+// min and in a max leftist heap, so that a message can be popped from both
+// ends and two messages merged in O(log n). A breakpoint popped from one
+// heap is only marked dead, and removed from the other one when it reaches
+// its top. Two live breakpoints at most tolerance apart that meet when heaps
+// are merged are coalesced, the slope delta of one being added to the other
+// which is marked dead: the message then has one breakpoint less.
+class Message;
+
+class BreakpointHeap
+{
+public:
+    BreakpointHeap(double tolerance = 0): tolerance(tolerance), coalesced(0) {}
+    int add(double x, double s);            // new breakpoint, alone in its heaps
+    int merge(int d, int h1, int h2);       // merge heaps h1 and h2 of direction d
+    int top(int d, int& h);                 // first live breakpoint of heap h
+    void pop(int d, int& h);                // remove the top of heap h
+    Message import(const BreakpointHeap& h, Message m); // append h, m being one of its messages
+    void chain(int first, int last);        // breakpoints first to last, added by increasing x, as one heap
+    double x(int i) const {return pts[i].x;}
+    double slope(int i) const {return pts[i].s;}
+    void clear() {pts.clear();}
+    size_t count() const {return coalesced;} // breakpoints coalesced so far
+private:
+    struct Breakpoint
+    {
+        double x, s;        // x-coordinate and slope delta
+        int left[2], right[2], rank[2]; // children and rank in the min (0) and max (1) heaps
+        bool dead;
+    };
+    int rank(int d, int h) const {return (h < 0)? 0: pts[h].rank[d];}
+    bool before(int d, int i, int j) const {return d == 0? pts[i].x < pts[j].x: pts[i].x > pts[j].x;}
+    std::vector<Breakpoint> pts;
+    double tolerance;   // negative to keep all breakpoints
+    size_t coalesced;
+};
+
 class Message
 {
 public:
     double am, bm; 	// slope and offset at -∞
     double ap, bp; 	// slope and offset at +∞
-    std::deque<double> breakpoints, slope;		// x-coordinate and slope delta of breakpoints
+    int heap[2];    // min and max heaps of breakpoints in a BreakpointHeap
+    int n;          // number of breakpoints
     
-    int length() const {return breakpoints.size();}
-    Message(): am(0), ap(0), bm(0), bp(0){}
-    Message(int l, double* b, double* s, double sm, double ym, double sp, double yp);    
-    void print();
+    int length() const {return n;}
+    Message(): am(0), bm(0), ap(0), bp(0), n(0) {heap[0] = heap[1] = -1;}
+};
+
+// Counters of the breakpoints of regressions, to which solves add theirs
+struct IsotonicStats
+{
+    size_t added;       // breakpoints added, one per node
+    size_t coalesced;   // breakpoints coalesced with an equal one
+    size_t total;       // sum of the sizes of the messages of the nodes
+    size_t largest;     // size of the largest message
+    IsotonicStats(): added(0), coalesced(0), total(0), largest(0) {}
+};
+
+// Forest of an isotonic regression stored in flat arrays, built once for any
+// number of regressions on it. Node i is a root if parent[i] < 0, else it is
+// constrained by sign[i]*(x[i]-x[parent[i]]) >= 0. The children are indexed
+// in CSR form to number the nodes in depth-first order, so that each subtree
+// is a range of positions and no node is allocated. The unary chains of nodes
+// having one child are consecutive positions, solved without the heaps.
+// Breakpoints at most tolerance apart are coalesced, moving breakpoints of
+// the messages by up to this much: 0 only merges equal ones, which quantized
+// data produce in numbers, and a negative tolerance keeps all of them.
+class IsotonicTree
+{
+public:
+    IsotonicTree(int n, const int* parent, const int* sign, double tolerance = 0);
+    int size() const {return (int)order.size();} // less than n if parent has a cycle
+    // Minimizer x of sum_i w[i]*(x[i]-y[i])^2 under the constraints. With
+    // several threads, large disjoint subtrees are solved concurrently, the
+    // result being identical to the sequential one.
+    void solve(const double* w, const double* y, double* x, int nbThreads = 1,
+               IsotonicStats* stats = 0) const;
+private:
+    friend class IsotonicSolver;
+    struct Ends;
+    int walk(int p, int first, const double* w, const double* y, double* v,
+             Message& mp, BreakpointHeap& heap, Ends& e) const;
+    int up(int p, int first, const double* w, const double* y, double* v,
+           Message* m, BreakpointHeap& heap, Ends& e) const;
+    void down(int p, double* v) const;
+    std::vector<int> order;     // node at each position
+    std::vector<int> parent;    // position of the parent, -1 for a root
+    std::vector<int> sign;      // sign of the node at each position
+    std::vector<int> subtree;   // number of positions of each subtree
+    double tolerance;           // of the coalescing of breakpoints
+};
+
+// Isotonic regression on an IsotonicTree kept between solves, for data
+// changing at a few nodes. The messages of the tops of chains are stored, so
+// that only the chains of the modified nodes and of their ancestors are solved
+// again, and values propagated down only from the nodes whose value changed.
+// The stored breakpoints take 16 bytes each, from a few per shape on a tree of
+// shapes to a few hundred on noise, see memory().
+class IsotonicSolver
+{
+public:
+    IsotonicSolver(const IsotonicTree& tree);
+    // Solve with weights w and data y, copied, setting x
+    void solve(const double* w, const double* y, double* x);
+    // Set the weight and data of node i for the next resolve(), after solve()
+    void update(int i, double w, double y);
+    // Solve after the updates, x being the previous result, of which only
+    // the changed values are written. The result is the one of solve().
+    void resolve(double* x);
+    size_t memory() const; // bytes used, the tree excluded
+private:
+    int chain(int b, IsotonicTree::Ends& e);
+    double clip(int p) const;
+    const IsotonicTree& tree;
+    std::vector<int> position;  // position of each node
+    std::vector<int> top;       // top of the chain of each position
+    std::vector<double> w, y;   // data of each node
+    std::vector<double> raw;    // value of each position before clipping
+    std::vector<double> value;  // value of each position
+    std::vector< std::vector<double> > message; // message of each top, see Ends::extract
+    std::vector<int> dirty;     // tops of the chains to solve again
+    std::vector<char> isDirty;  // of each top
 };
 
+// Solve the isotonic regression on the tree of root, setting x of its nodes.
+// The tree is copied to an IsotonicTree.
+void Recursive_Tree_Search(Node &root, int nbThreads = 1);
 
-void Recursive_Tree_Search(Node &root);
\ No newline at end of file
+// Isotonic regression on a chain of n nodes: non decreasing x minimizing
+// sum_i w[i]*(x[i]-y[i])^2, by pool adjacent violators on a stack of blocks,
+// in O(n). The weighted counterpart of isotonic_chain.m.
+void isotonic_chain(int n, const double* w, const double* y, double* x);
@@ -1,63 +1,97 @@
 #include "isotonic_regression_tree.h"
+#include "parallel.h"
+#include <algorithm>
 
 // Entry point for Matlab
 //
 // Input:
-// T: the tree of size Nx1 is encoded through a single array of parents
+// T: the tree of size Nx1 is encoded through a single array of parents,
+// T(i)=0 for a root
 // s: array of signs of size Nx1 (s(i)=1 means that the node is larger than its parent)
-// w: array of weights of size Nx1
-// y: array of data of size Nx1
+// w: array of weights of size Nx1, or NxK for weights by column of y
+// y: array of data of size NxK, whose K columns are independent problems
+// on the same tree, solved on all the cores
+// tol (optional): breakpoints of the messages at most tol apart are
+// coalesced. 0 (default) only merges equal ones, leaving x unchanged up to
+// rounding, -1 keeps all of them. A positive tol gives smaller messages but
+// an approximate x, whose error may be much larger than tol.
 //
 // Output:
-// x: minimizer of ||sqrt(w).*(x-y)||_2^2 s.t. s_i(x_i-x_j)>=0, (i,j) in E
+// x: minimizer of ||sqrt(w).*(x-y)||_2^2 s.t. s_i(x_i-x_j)>=0, (i,j) in E,
+// of size NxK
+// stats (optional): [breakpoints added; coalesced; sum of the sizes of the
+// messages of the nodes; size of the largest message], over the K problems
 //
 // Compilation: mex isotonic_regression_tree.cpp -o isotononic_regression_tree_mex.cpp
 //
 void mexFunction( int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-    // Ouput : x
-    // Input : T, s, w, y
+    // Ouput : x, stats
+    // Input : T, s, w, y, tol
     
     // Check for proper input
+    double tol = 0;
     switch(nrhs) {
         case 4 : /*mexPrintf("Good call.\n");*/
             break;
+        case 5 :
+            tol = mxGetScalar(prhs[4]);
+            break;
         default: mexErrMsgTxt("Bad number of inputs.\n");
         break;
     }
-    if (nlhs > 1) {mexErrMsgTxt("Too many outputs.\n");}
+    if (nlhs > 2) {mexErrMsgTxt("Too many outputs.\n");}
     
-    int n;
+    int n, K;
     double *T,*s,*w,*y,*x;
     
     // Get input arguments
-    // Note that n0 and n1 are reversed because of row major in C VS column major format in Matlab
     T=mxGetPr(prhs[0]);
     s=mxGetPr(prhs[1]);
     w=mxGetPr(prhs[2]);
     y=mxGetPr(prhs[3]);
     
-    // Size of the image...
+    // Number of nodes and of problems
     n=mxGetM(prhs[0]); //number of rows
+    K=mxGetN(prhs[3]); //number of columns
+    if (mxGetNumberOfElements(prhs[1]) != (size_t)n) {mexErrMsgTxt("s should be of the size of T.\n");}
+    if (mxGetM(prhs[3]) != (size_t)n) {mexErrMsgTxt("y should have as many rows as T.\n");}
+    if (mxGetNumberOfDimensions(prhs[3]) > 2) {mexErrMsgTxt("y should be a matrix.\n");}
+    const bool wColumns = (mxGetNumberOfElements(prhs[2]) != (size_t)n);
+    if (wColumns && (mxGetM(prhs[2]) != (size_t)n || mxGetN(prhs[2]) != (size_t)K)) {mexErrMsgTxt("w should be of size Nx1 or of the size of y.\n");}
     
     // Create output arguments
-    plhs[0] = mxCreateDoubleMatrix(n,1,mxREAL);
+    plhs[0] = mxCreateDoubleMatrix(n,K,mxREAL);
     x=mxGetPr(plhs[0]);
     
-    Node root(s[0], 0, y[0], w[0]);
-    Node **nodes = new Node*[n];
-    nodes[0] = &root;
-    for (int i = 1; i < n; ++i)
+    std::vector<int> parent(n), sign(n);
+    for (int i = 0; i < n; ++i)
     {
-        Node* tmp = new Node(s[i], i, y[i], w[i]);
-        nodes[i] = tmp;
-        nodes[int(T[i])-1]->addChildren(tmp);
+        if (!(T[i] >= 0 && T[i] <= n)) {mexErrMsgTxt("T should contain parents between 0 and N.\n");}
+        parent[i] = int(T[i])-1;
+        sign[i] = int(s[i]);
     }
-    Recursive_Tree_Search(root);
+    const IsotonicTree tree(n, parent.data(), sign.data(), tol);
+    if (tree.size() != n) {mexErrMsgTxt("T should not have cycles.\n");}
     
-    for (int i = 0; i < n; ++i)
+    // Threads left over by the problems go to the regression of each one
+    const int nbThreads = default_threads();
+    const int nbInner = std::max(1, nbThreads / std::max(1, K));
+    std::vector<IsotonicStats> stats(K);
+    parallel_for(K, nbThreads, [&](int k) {
+        const size_t offset = (size_t)k*n;
+        tree.solve(wColumns? w+offset: w, y+offset, x+offset, nbInner, &stats[k]);
+    });
+    
+    if (nlhs > 1)
     {
-        x[i] = nodes[i]->x;
+        plhs[1] = mxCreateDoubleMatrix(4,1,mxREAL);
+        double* out = mxGetPr(plhs[1]);
+        for (int k = 0; k < K; ++k)
+        {
+            out[0] += stats[k].added;
+            out[1] += stats[k].coalesced;
+            out[2] += stats[k].total;
+            out[3] = std::max(out[3], (double)stats[k].largest);
+        }
     }
-    
-    delete[] nodes;
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+/// Default number of threads: the number of cores.
+inline int default_threads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return (n == 0)? 1: (int)n;
+}
+
+/// Call \a f(i) for i in [0,n) on \a nbThreads threads, the calling one
+/// included. Indices are handed out in increasing order to idle threads.
+template <class F>
+void parallel_for(int n, int nbThreads, F f) {
+    if(nbThreads > n)
+        nbThreads = n;
+    if(nbThreads <= 1) {
+        for(int i = 0; i < n; i++)
+            f(i);
+        return;
+    }
+    std::atomic<int> next(0);
+    auto work = [&]() {
+        for(int i; (i = next++) < n;)
+            f(i);
+    };
+    std::vector<std::thread> threads;
+    for(int t = 1; t < nbThreads; t++)
+        threads.push_back(std::thread(work));
+    work();
+    for(size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
+
+/// Barrier of \a n threads, reusable: wait() returns once the \a n threads
+/// have called it, for threads of parallel_for iterating in lockstep.
+class Barrier {
+public:
+    explicit Barrier(int n): count(n), waiting(0), generation(0) {}
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        const unsigned g = generation;
+        if(++waiting == count) {
+            waiting = 0;
+            generation++;
+            cond.notify_all();
+        } else
+            cond.wait(lock, [&]() { return generation != g; });
+    }
+private:
+    const int count;
+    int waiting;
+    unsigned generation;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+#endif
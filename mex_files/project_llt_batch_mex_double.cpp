@@ -0,0 +1,205 @@
+#include "compact_tree_double.h"
+#include "project_llt_double.h"
+#include "parallel.h"
+#include <vector>
+#include <ctime>
+#include <cmath>
+#include <string>
+#include "mex.h"
+
+// Tree of the image \a u0 of size \a w x \a h, whose pixels are of type T
+template <typename T>
+LsCompactTree* CreateTree(const T* u0, int w, int h, LsTree::Algo algo)
+{
+    return new LsCompactTree(u0, w, h, algo);
+}
+
+// Weighted sum \a lum of the C = weight.size() channels of \a u0, each of
+// N pixels
+template <typename T>
+void Luminance(const T* u0, size_t N, const std::vector<double>& weight, double* lum)
+{
+    for (size_t i=0;i<N;++i)
+        lum[i] = 0;
+    for (size_t c=0;c<weight.size();++c)
+        for (size_t i=0;i<N;++i)
+            lum[i] += weight[c]*u0[i+c*N];
+}
+
+// Values of the K images \a u1 of N pixels made contiguous at each pixel
+template <typename T>
+void Interleave(const T* u1, size_t N, int K, double* uu1)
+{
+    for (int k=0;k<K;++k)
+        for (size_t i=0;i<N;++i)
+            uu1[i*K+k] = u1[i+k*N];
+}
+
+// SNR \a snr of each of the K images \a u with respect to the image of \a u1
+template <typename T>
+void Snr(const T* u1, const double* u, size_t N, int K, double* snr)
+{
+    for (int k=0;k<K;++k){
+        const T* ref = u1+k*N;
+        const double* uk = u+k*N;
+        double err=0, norm=0;
+        for (size_t i=0;i<N;++i){
+            err += (uk[i]-ref[i])*(uk[i]-ref[i]);
+            norm += (double)ref[i]*ref[i];
+        }
+        snr[k] = -10*log10(err/norm);
+    }
+}
+
+// Entry point for Matlab
+//
+// Same as project_llt_mex_double, for K images projected on the same tree:
+// the tree is built once and the images are swept once. The K images can be
+// several references, the frames of a burst or the channels of a color image.
+//
+// Input:
+// u0: image whose tree of shapes is computed, n0 x n1 or n0 x n1 x C
+// u1: n0 x n1 x K array, images projected on the tree of u0
+// Both may be of class uint8, uint16, single or double.
+// algo (optional): 'flst' (default), 'uf' or 'parallel', see
+// project_llt_mex_double
+// channel (optional): for a multichannel u0, channel whose tree is computed,
+// or 0 (default) for the luminance
+//
+// Output:
+// u: n0 x n1 x K array, projections of the images of u1
+// snr: K x 1, SNR of each projection with respect to its image of u1
+// times: [time_tree;time_DP;time_total]
+//
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // Ouput : u, snr, [time_tree;time_DP;time_total]
+    // Input : u0, u1, algo, channel
+    int n0,n1,C,K,channel=0;
+    size_t N;
+    double *u; double *snr;
+
+	using namespace std;
+
+    double *times;
+	double t_ini, tree_time, DP_time;
+	clock_t t_begin, t_end;
+
+    t_begin=clock();
+    t_ini=t_begin;
+
+    // Check for proper input
+    LsTree::Algo algo = LsTree::FLST;
+    switch(nrhs) {
+        case 2 :
+        break;
+        case 4 :
+            channel=(int)mxGetScalar(prhs[3]);
+            // fall through
+        case 3 :
+        {
+            char name[16];
+            if (mxGetString(prhs[2], name, sizeof(name))) {mexErrMsgTxt("Algo should be 'flst', 'uf' or 'parallel'.\n");}
+            if (string(name) == "uf") {algo = LsTree::UNION_FIND;}
+            else if (string(name) == "parallel") {algo = LsTree::PARALLEL;}
+            else if (string(name) != "flst") {mexErrMsgTxt("Algo should be 'flst', 'uf' or 'parallel'.\n");}
+        }
+        break;
+        default: mexErrMsgTxt("Bad number of inputs.\n");
+        break;
+    }
+    if (nlhs > 3) {mexErrMsgTxt("Too many outputs.\n");}
+
+    // Get input arguments
+    n0=mxGetM(prhs[0]); //number of rows
+    n1=mxGetDimensions(prhs[0])[1]; //number of columns
+    N=(size_t)n0*n1;
+    C=mxGetNumberOfElements(prhs[0]) / N;
+    if (mxGetNumberOfDimensions(prhs[0]) > 3) {mexErrMsgTxt("u0 should be of size n0 x n1 x C.\n");}
+    if (channel < 0 || channel > C) {mexErrMsgTxt("Bad channel.\n");}
+    if (!LsTree::supports(n0, n1, algo)) {mexErrMsgTxt("Image too large, see LS_WIDE in compile.m.\n");}
+    if (mxGetM(prhs[1]) != (size_t)n0 || mxGetNumberOfElements(prhs[1]) % N != 0)
+    {mexErrMsgTxt("u1 should be of size size(u0,1) x size(u0,2) x K.\n");}
+    K=mxGetNumberOfElements(prhs[1]) / N;
+    if (mxGetNumberOfDimensions(prhs[1]) > 2 && mxGetDimensions(prhs[1])[1] != (size_t)n1)
+    {mexErrMsgTxt("u1 should be of size size(u0,1) x size(u0,2) x K.\n");}
+
+    plhs[0] = mxCreateNumericArray(mxGetNumberOfDimensions(prhs[1]), mxGetDimensions(prhs[1]), mxDOUBLE_CLASS, mxREAL);
+    plhs[1] = mxCreateDoubleMatrix(K,1,mxREAL);
+    plhs[2] = mxCreateDoubleMatrix(3,1,mxREAL);
+    u=mxGetPr(plhs[0]);
+    snr=mxGetPr(plhs[1]);
+    times=mxGetPr(plhs[2]);
+
+    // 1) Compute the tree of u0, of its luminance or of one of its channels.
+    // As in project_llt_mex_double, it is computed in the column major order,
+    // n0 and n1 being the width and the height. A single channel is read in
+    // its own type, the luminance is computed in double.
+    t_begin=clock();
+    LsCompactTree* tree = 0;
+    if (C == 1 || channel > 0) {
+        size_t offset = (channel > 0)? (channel-1)*N: 0;
+        switch (mxGetClassID(prhs[0])) {
+            case mxUINT8_CLASS : tree = CreateTree((const uint8_t*)mxGetData(prhs[0])+offset, n0, n1, algo); break;
+            case mxUINT16_CLASS : tree = CreateTree((const uint16_t*)mxGetData(prhs[0])+offset, n0, n1, algo); break;
+            case mxSINGLE_CLASS : tree = CreateTree((const float*)mxGetData(prhs[0])+offset, n0, n1, algo); break;
+            case mxDOUBLE_CLASS : tree = CreateTree((const double*)mxGetData(prhs[0])+offset, n0, n1, algo); break;
+            default: mexErrMsgTxt("u0 should be of class uint8, uint16, single or double.\n");
+        }
+    } else {
+        std::vector<double> weight(C, 1.0/C);
+        if (C == 3) { // Luma of ITU-R BT.601
+            weight[0] = 0.299; weight[1] = 0.587; weight[2] = 0.114;
+        }
+        std::vector<double> lum(N);
+        switch (mxGetClassID(prhs[0])) {
+            case mxUINT8_CLASS : Luminance((const uint8_t*)mxGetData(prhs[0]), N, weight, &lum[0]); break;
+            case mxUINT16_CLASS : Luminance((const uint16_t*)mxGetData(prhs[0]), N, weight, &lum[0]); break;
+            case mxSINGLE_CLASS : Luminance((const float*)mxGetData(prhs[0]), N, weight, &lum[0]); break;
+            case mxDOUBLE_CLASS : Luminance((const double*)mxGetData(prhs[0]), N, weight, &lum[0]); break;
+            default: mexErrMsgTxt("u0 should be of class uint8, uint16, single or double.\n");
+        }
+        tree = CreateTree((const double*)&lum[0], n0, n1, algo);
+    }
+    t_end=clock();
+    tree_time =  double(t_end - t_begin) / CLOCKS_PER_SEC;
+    if (tree->iNbShapes == 0) {delete tree; mexErrMsgTxt("Too many shapes.\n");}
+
+    // 2) Evaluates averages and counts of the K images on the shapes of u0.
+    // Values of u1 at a pixel are made contiguous.
+    std::vector<double> uu1(N*K), avg, x;
+    std::vector<LsIndex> count;
+    switch (mxGetClassID(prhs[1])) {
+        case mxUINT8_CLASS : Interleave((const uint8_t*)mxGetData(prhs[1]), N, K, &uu1[0]); break;
+        case mxUINT16_CLASS : Interleave((const uint16_t*)mxGetData(prhs[1]), N, K, &uu1[0]); break;
+        case mxSINGLE_CLASS : Interleave((const float*)mxGetData(prhs[1]), N, K, &uu1[0]); break;
+        case mxDOUBLE_CLASS : Interleave((const double*)mxGetData(prhs[1]), N, K, &uu1[0]); break;
+        default: delete tree; mexErrMsgTxt("u1 should be of class uint8, uint16, single or double.\n");
+    }
+    shape_means(*tree, &uu1[0], K, avg, count);
+
+    // 3) Call the isotonic regressions, in parallel -> x
+    t_begin=clock();
+    project_shapes(*tree, avg, count, K, x, default_threads());
+    t_end=clock();
+    DP_time =  double(t_end - t_begin) / CLOCKS_PER_SEC;
+
+    // 4) Reconstruct the images u from x, and their SNR
+    build_images(*tree, x, K, &uu1[0]);
+    delete tree;
+    for (int k=0;k<K;++k){
+        double* uk = u+(size_t)k*N;
+        for (size_t i=0;i<N;++i)
+            uk[i] = uu1[i*K+k];
+    }
+    switch (mxGetClassID(prhs[1])) {
+        case mxUINT8_CLASS : Snr((const uint8_t*)mxGetData(prhs[1]), u, N, K, snr); break;
+        case mxUINT16_CLASS : Snr((const uint16_t*)mxGetData(prhs[1]), u, N, K, snr); break;
+        case mxSINGLE_CLASS : Snr((const float*)mxGetData(prhs[1]), u, N, K, snr); break;
+        default : Snr((const double*)mxGetData(prhs[1]), u, N, K, snr); break;
+    }
+
+    t_end=clock();
+    times[0]=tree_time;
+    times[1]=DP_time;
+    times[2]=double(t_end - t_ini) / CLOCKS_PER_SEC;
+}
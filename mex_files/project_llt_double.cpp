@@ -0,0 +1,100 @@
+#include "project_llt_double.h"
+#include "tos_union_find_double.h"
+#include "isotonic_regression_tree.h"
+#include "parallel.h"
+#include <algorithm>
+
+template <typename T>
+void shape_means(const LsCompactTree& tree, const T* u, int K,
+                 std::vector<double>& mean, std::vector<LsIndex>& count)
+{
+    mean.assign((size_t)tree.iNbShapes*K, 0);
+    count.assign(tree.iNbShapes, 0);
+    const size_t n = tree.size();
+    for (size_t i = 0; i < n; ++i)
+    {
+        int32_t smallest = tree.smallestShape[i];
+        double* m = &mean[(size_t)smallest*K];
+        const T* v = &u[i*K];
+        for (int k = 0; k < K; ++k)
+            m[k] += v[k];
+        count[smallest]++;
+    }
+    for (int i = 0; i < tree.iNbShapes; ++i)
+    {
+        double* m = &mean[(size_t)i*K];
+        for (int k = 0; k < K; ++k)
+            m[k] /= count[i];
+    }
+}
+
+template void shape_means(const LsCompactTree&, const uint8_t*, int,
+                          std::vector<double>&, std::vector<LsIndex>&);
+template void shape_means(const LsCompactTree&, const uint16_t*, int,
+                          std::vector<double>&, std::vector<LsIndex>&);
+template void shape_means(const LsCompactTree&, const float*, int,
+                          std::vector<double>&, std::vector<LsIndex>&);
+template void shape_means(const LsCompactTree&, const double*, int,
+                          std::vector<double>&, std::vector<LsIndex>&);
+
+void project_shapes(const LsCompactTree& tree, const std::vector<double>& mean,
+                    const std::vector<LsIndex>& count, int K,
+                    std::vector<double>& x, int nbThreads)
+{
+    const int n = tree.iNbShapes;
+    x.resize((size_t)n*K);
+    // Tree of the regressions, whose constraints are given by the types
+    std::vector<int> sign(n);
+    std::vector<double> w(n);
+    for (int i = 0; i < n; ++i)
+    {
+        sign[i] = (tree.type[i] == LsShape::INF) ? -1 : 1;
+        w[i] = count[i];
+    }
+    const IsotonicTree regression(n, &tree.parent[0], &sign[0]);
+    // Threads left over by the targets go to the regression of each target
+    const int nbInner = std::max(1, nbThreads / std::max(1, K));
+    nbThreads = std::max(1, std::min(nbThreads, K));
+    parallel_for(nbThreads, nbThreads, [&](int t) {
+        std::vector<double> yk(n), xk(n);
+        for (int k = t; k < K; k += nbThreads)
+        {
+            for (int i = 0; i < n; ++i)
+                yk[i] = mean[(size_t)i*K+k];
+            regression.solve(&w[0], &yk[0], &xk[0], nbInner);
+            for (int i = 0; i < n; ++i)
+                x[(size_t)i*K+k] = xk[i];
+        }
+    });
+}
+
+void build_images(const LsCompactTree& tree, const std::vector<double>& x,
+                  int K, double* out)
+{
+    const size_t n = tree.size();
+    for (size_t i = 0; i < n; ++i)
+    {
+        const double* v = &x[(size_t)tree.smallestShape[i]*K];
+        double* o = &out[i*K];
+        for (int k = 0; k < K; ++k)
+            o[k] = v[k];
+    }
+}
+
+size_t project_memory_estimate(size_t w, size_t h, size_t nbShapes, int K,
+                               LsTree::Algo algo, int nbThreads)
+{
+    const size_t tree = LsCompactTree::memory_estimate(w*h, nbShapes);
+    // Per thread, data, values, messages and breakpoints of the regression
+    const size_t node = 3*sizeof(double) + sizeof(Message) + 64;
+    size_t build = tree;
+    if (algo == LsTree::FLST)
+        build += LsTree::memory_estimate(w, h, nbShapes, algo);
+    else // Grid of the immersion, parents and levels
+        build += tos_union_find_faces((int)w, (int)h) * 20 +
+            nbShapes * (sizeof(int) + sizeof(double));
+    size_t project = tree + nbShapes * (2*K*sizeof(double) + sizeof(LsIndex)) +
+        nbShapes * (sizeof(double) + 5*sizeof(int)) +
+        std::max(1, std::min(nbThreads, K)) * nbShapes * node;
+    return std::max(build, project);
+}
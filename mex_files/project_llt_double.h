@@ -0,0 +1,39 @@
+#ifndef PROJECT_LLT_H
+#define PROJECT_LLT_H
+
+#include "compact_tree_double.h"
+#include <vector>
+#include <stdint.h>
+
+// Projection of K images on the set of images having the tree of shapes
+// \a tree up to a local contrast change, by isotonic regression on the tree.
+// The K values of a pixel, or of a shape, are contiguous: value of pixel i in
+// image k is at index i*K+k.
+
+/// Means \a mean of the K images \a u on the private pixels of each shape,
+/// whose number is stored in \a count. Images are swept once. Pixels are of
+/// type uint8_t, uint16_t, float or double.
+template <typename T>
+void shape_means(const LsCompactTree& tree, const T* u, int K,
+                 std::vector<double>& mean, std::vector<LsIndex>& count);
+
+/// Isotonic regression on the tree of each of the K \a mean, weighted by
+/// \a count: gray levels \a x of the shapes in the K projections. The K
+/// regressions are distributed on \a nbThreads threads, and each one uses
+/// several threads if there are more threads than regressions.
+void project_shapes(const LsCompactTree& tree, const std::vector<double>& mean,
+                    const std::vector<LsIndex>& count, int K,
+                    std::vector<double>& x, int nbThreads = 1);
+
+/// Build the K images \a out whose shapes have gray levels \a x.
+void build_images(const LsCompactTree& tree, const std::vector<double>& x,
+                  int K, double* out);
+
+/// Estimate of the peak number of bytes used to project K images of size
+/// \a w x \a h on their tree computed by \a algo, having \a nbShapes shapes,
+/// with \a nbThreads threads. The images and their projections are not
+/// counted. The number of shapes is at most w*h, usually 5 to 20% of it.
+size_t project_memory_estimate(size_t w, size_t h, size_t nbShapes, int K,
+                               LsTree::Algo algo, int nbThreads = 1);
+
+#endif
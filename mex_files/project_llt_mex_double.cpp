@@ -1,6 +1,11 @@
 #include "flst_double.cpp"
+#include "compact_tree_double.h"
+#include "project_llt_double.h"
+#include "tos_union_find_double.h"
+#include "parallel.h"
 #include <vector>
 #include <ctime>
+#include <string>
 #include "isotonic_regression_tree.h"
 #include "mex.h"
 
@@ -17,51 +22,47 @@ double average(std::vector<LsPoint> &contour, double *u1, int n1)
 }
 
 
-// Copies the FLST tree to a form interpretable by the isotonic regression
-static int localNodeId = 0;
-void CreateNodeFromShapeTree(Node *vroot, LsShape* sroot, std::vector<std::pair<Node*, LsShape*>> *VectorLinks)
+void Debug(const LsCompactTree &tree)
 {
-    VectorLinks->push_back(std::pair<Node*, LsShape*>(vroot,sroot));
-    sroot->shapeId = localNodeId;
-    
-    for (LsShape* child = sroot->find_child();
-    child!=0;child=child->find_sibling())
+    LsCompactTreeIterator it(LsCompactTreeIterator::Pre, tree, 0);
+    auto end = LsCompactTreeIterator::end(LsCompactTreeIterator::Pre, tree, 0);
+    for (; it != end; ++it)
     {
-        ++localNodeId;
-        int sign = (child->type == LsShape::INF) ? -1 : 1;
-        Node *vchild = new Node(sign, localNodeId, 0, 0);
-        vroot->addChildren(vchild);
-        CreateNodeFromShapeTree(vchild, child, VectorLinks);
+        mexPrintf("Tree - gray = %1.2e",tree.gray[*it]);
+        mexPrintf(" - area = %.0f",(double)tree.area[*it]);
+        mexPrintf(" - id = %i\n",*it);
     }
 }
 
-
-void Debug(LsShape *shape, int n0, int n1)
+// Tree of the image or volume \a u0, of size \a n0 x \a n1 x \a n2, whose
+// pixels are of type T
+template <typename T>
+LsCompactTree* CreateTree(const mxArray *u0, int n0, int n1, int n2, LsTree::Algo algo)
 {
-    LsTreeIterator it(LsTreeIterator::Pre, shape);
-    auto end = LsTreeIterator::end(LsTreeIterator::Pre, shape);
-    for (; it != end; ++it)
-    {
-        mexPrintf("Tree - gray = %1.2e",(*it)->gray);
-        mexPrintf(" - area = %i",(*it)->area);
-        mexPrintf(" - id = %i\n",(*it)->shapeId);
-        /*for(int i = 0; i < (*it)->area; ++i)
-         * {
-         * //if (p.x < n0 && p.y < n1)
-         * mexPrintf("\t point : %i, %i \n", (*it)->pixels[i].x, (*it)->pixels[i].y);
-         * }/*
-         * for (auto p :  (*it)->contour)
-         * {
-         * mexPrintf("\t point : %i, %i \n", p.x, p.y);
-         * }  */
-    }
+    const T* gray = (const T*)mxGetData(u0);
+    if (n2 > 1)
+        return new LsCompactTree(gray, n0, n1, n2, algo);
+    return new LsCompactTree(gray, n0, n1, algo);
 }
 
+// Entry point for Matlab
+//
+// Input:
+// u0: image whose tree of shapes is computed, or volume (n0 x n1 x n2)
+// u1: image projected on the tree of u0, of the same size
+// Both may be of class uint8, uint16, single or double.
+// algo (optional): 'flst' (default), 'uf' or 'parallel' (union-find on all
+// cores), algorithm computing the tree. Volumes always use the union-find.
+//
+// Output:
+// u: projection of u1
+// times: [time_tree;time_DP;time_total]
+//
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
     // Ouput : u, [time_tree;time_DP;time_total]
-    // Input : u0, u1
-    int n0,n1;
-    double *u; double *u0; double *u1;
+    // Input : u0, u1, algo
+    int n0,n1,n2;
+    double *u;
     
 	using namespace std;
 	
@@ -74,98 +75,79 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
     t_ini=t_begin;
 
     // Check for proper input
+    LsTree::Algo algo = LsTree::FLST;
     switch(nrhs) {
         case 2 : //mexPrintf("Projection being computed.\n");
         break;
+        case 3 :
+        {
+            char name[16];
+            if (mxGetString(prhs[2], name, sizeof(name))) {mexErrMsgTxt("Algo should be 'flst', 'uf' or 'parallel'.\n");}
+            if (string(name) == "uf") {algo = LsTree::UNION_FIND;}
+            else if (string(name) == "parallel") {algo = LsTree::PARALLEL;}
+            else if (string(name) != "flst") {mexErrMsgTxt("Algo should be 'flst', 'uf' or 'parallel'.\n");}
+        }
+        break;
         default: mexErrMsgTxt("Bad number of inputs.\n");
         break;
     }
     if (nlhs > 2) {mexErrMsgTxt("Too many outputs.\n");}
     
     // Get input arguments
-    u0=mxGetPr(prhs[0]);
-    u1=mxGetPr(prhs[1]);
     n0=mxGetM(prhs[0]); //number of rows
-    n1=mxGetN(prhs[0]); //number of columns
-    
-    // Note that n0 and n1 are reversed because of row major in C VS column major format in Matlab
-    plhs[0] = mxCreateDoubleMatrix(n0,n1,mxREAL);
+    n1=mxGetDimensions(prhs[0])[1]; //number of columns
+    n2=mxGetNumberOfElements(prhs[0])/((size_t)n0*n1); //number of slices
+    if (mxGetNumberOfDimensions(prhs[0]) > 3) {mexErrMsgTxt("u0 should be an image or a volume.\n");}
+    if (mxGetNumberOfElements(prhs[1]) != mxGetNumberOfElements(prhs[0])) {mexErrMsgTxt("u0 and u1 should have the same size.\n");}
+    if (n2 > 1 && tos_union_find_faces(n0, n1, n2) >= 0xFFFFFFFE) {mexErrMsgTxt("Volume too large.\n");}
+    if (n2 == 1 && !LsTree::supports(n0, n1, algo)) {mexErrMsgTxt("Image too large, see LS_WIDE in compile.m.\n");}
+    
+    plhs[0] = mxCreateNumericArray(mxGetNumberOfDimensions(prhs[0]), mxGetDimensions(prhs[0]), mxDOUBLE_CLASS, mxREAL);
     plhs[1] = mxCreateDoubleMatrix(3,1,mxREAL);
     u=mxGetPr(plhs[0]);
     times=mxGetPr(plhs[1]);
     
-    double* uu0=new double[n0*n1];
-    double* uu1=new double[n0*n1];
-    
     // 1) Compute the FLLT of u0.
-    for (int i=0;i<n0;++i){
-        for (int j=0;j<n1;++j){
-            uu0[j+i*n1] = u0[i+j*n0];
-            uu1[j+i*n1] = u1[i+j*n0];
-        }
-    }
-    
+    // The tree of the transposed image being the transposed tree, it is
+    // computed in the column major order of Matlab, n0 and n1 being the
+    // width and the height. Pixels are read in their own type.
     t_begin=clock();
-    LsTree tree(uu0, n1, n0);
+    LsCompactTree* tree = 0;
+    switch (mxGetClassID(prhs[0])) {
+        case mxUINT8_CLASS : tree = CreateTree<uint8_t>(prhs[0], n0, n1, n2, algo); break;
+        case mxUINT16_CLASS : tree = CreateTree<uint16_t>(prhs[0], n0, n1, n2, algo); break;
+        case mxSINGLE_CLASS : tree = CreateTree<float>(prhs[0], n0, n1, n2, algo); break;
+        case mxDOUBLE_CLASS : tree = CreateTree<double>(prhs[0], n0, n1, n2, algo); break;
+        default: mexErrMsgTxt("u0 should be of class uint8, uint16, single or double.\n");
+    }
     t_end=clock();
     tree_time =  double(t_end - t_begin) / CLOCKS_PER_SEC;
-	//mexPrintf("Tree:%1.2e -- #shapes=%i \n",tree_time,tree.iNbShapes);
-    
-    // 2) Copies the tree and evaluates the mean of u1 on the LL of u0.
-    LsShape* ShapeRoot = &tree.shapes[0];
-    
-    //find the root
-    while(ShapeRoot->find_parent()) {ShapeRoot = ShapeRoot->find_parent();}
-    // Recursive copy
-    Node ValueRoot(0, 0,0,ShapeRoot->contour.size());
-    // A list of pointers mapping the nodes from the nodetree to the nodes of the shapetree
-    std::vector<std::pair<Node*, LsShape*>> VectorLinks;
-    
-    localNodeId = 0; // This line is very important, if you remove it, the function will crash after a few calls
-    CreateNodeFromShapeTree(&ValueRoot, ShapeRoot, &VectorLinks);
-    
-    // 3) Evaluates averages and counts
-    double* avg=new double[tree.iNbShapes]();
-    int* count=new int[tree.iNbShapes]();
-    for(int i = 0; i<n0*n1; ++i)
-    {
-        LsShape *smallest = tree.smallest_shape(i);
-        avg[smallest->shapeId] += uu1[i];
-        count[smallest->shapeId]++;
-    }
-    for(int i = 0; i<tree.iNbShapes; ++i)
-    {
-        avg[i]/=count[i];
-        VectorLinks[i].first->y = avg[i];
-        VectorLinks[i].first->w = count[i];
+    if (tree->iNbShapes == 0) {delete tree; mexErrMsgTxt("Too many shapes.\n");}
+	//mexPrintf("Tree:%1.2e -- #shapes=%i \n",tree->iNbShapes);
+    
+    // 2) Evaluates averages and counts of u1 on the shapes of u0
+    std::vector<double> avg, x;
+    std::vector<LsIndex> count;
+    switch (mxGetClassID(prhs[1])) {
+        case mxUINT8_CLASS : shape_means(*tree, (const uint8_t*)mxGetData(prhs[1]), 1, avg, count); break;
+        case mxUINT16_CLASS : shape_means(*tree, (const uint16_t*)mxGetData(prhs[1]), 1, avg, count); break;
+        case mxSINGLE_CLASS : shape_means(*tree, (const float*)mxGetData(prhs[1]), 1, avg, count); break;
+        case mxDOUBLE_CLASS : shape_means(*tree, (const double*)mxGetData(prhs[1]), 1, avg, count); break;
+        default: delete tree; mexErrMsgTxt("u1 should be of class uint8, uint16, single or double.\n");
     }
     
-    // 4) Call the isotonic regression -> x
+    // 3) Call the isotonic regression -> x
    	t_begin=clock();
-    Recursive_Tree_Search(ValueRoot);
+    project_shapes(*tree, avg, count, 1, x,
+                   (algo == LsTree::PARALLEL)? default_threads(): 1);
     t_end=clock();
     DP_time +=  double(t_end - t_begin) / CLOCKS_PER_SEC;
    	//mexPrintf("DP 1:%1.2e \n", DP_time);
     
-    // Here, we assign x to tree.
-    for (std::pair<Node*, LsShape*> link : VectorLinks)
-    {
-        link.second->gray = link.first->x;
-    }
-    
-    // 5) Reconstruct an image u from x 
-    double *uu=tree.build_image();
-    for (int i=0;i<n0;++i){
-        for (int j=0;j<n1;++j){
-            u[i+j*n0]=uu[j+i*n1];
-        }
-    }
+    // 4) Reconstruct an image u from x 
+    build_images(*tree, x, 1, u);
 
-    delete uu0;
-    delete uu1;
-    delete avg;
-    delete count;
-    delete uu;
+    delete tree;
     
     t_end=clock();
     times[0]=tree_time;
@@ -0,0 +1,79 @@
+#include "region_graph.h"
+#include "connected_components.h"
+#include <algorithm>
+
+template <typename T, typename T0>
+RegionGraph::RegionGraph(const T* u, int h, int w, const T0* u0, int nbThreads)
+: nrow(h), ncol(w), label(size()) {
+    // Sizes of the regions and sums of u0 computed while labelling
+    ComponentStats stats;
+    nbRegions = connected_components(u, h, w, label.data(), u0, u0? 1: 0,
+                                     stats, 0, nbThreads);
+    count.swap(stats.area);
+    sum.swap(stats.sum);
+
+    // Pairs of regions (larger, smaller) of the pixels adjacent downward
+    // (d=0) and rightward (d=1), a pair repeating the previous one in the
+    // same direction being skipped
+    std::vector<int32_t> from, to;
+    int32_t last[2][2] = {{-1,-1}, {-1,-1}};
+    for(int x = 0; x < w; x++)
+        for(int y = 0; y < h; y++) {
+            const int p = x*h+y;
+            const int32_t l = label[p];
+            for(int d = 0; d < 2; d++) {
+                if((d == 0)? y+1 == h: x+1 == w)
+                    continue;
+                const int q = (d == 0)? p+1: p+h;
+                if(u[q] == u[p])
+                    continue;
+                int32_t a = l, b = label[q];
+                if(u[q] > u[p])
+                    std::swap(a, b);
+                if(a == last[d][0] && b == last[d][1])
+                    continue;
+                last[d][0] = a;
+                last[d][1] = b;
+                from.push_back(a);
+                to.push_back(b);
+            }
+        }
+
+    // Pairs bucketed by larger region, then deduplicated and sorted in each
+    // bucket
+    start.assign(nbRegions+1, 0);
+    for(size_t k = 0; k < from.size(); k++)
+        start[from[k]+1]++;
+    for(int i = 0; i < nbRegions; i++)
+        start[i+1] += start[i];
+    smaller.resize(from.size());
+    std::vector<int32_t> next(start.begin(), start.end()-1);
+    for(size_t k = 0; k < from.size(); k++)
+        smaller[next[from[k]]++] = to[k];
+    std::vector<int32_t> seen(nbRegions, -1);
+    int32_t e = 0;
+    for(int i = 0; i < nbRegions; i++) {
+        const int32_t begin = start[i], end = start[i+1];
+        start[i] = e;
+        for(int32_t k = begin; k < end; k++)
+            if(seen[smaller[k]] != i) {
+                seen[smaller[k]] = i;
+                smaller[e++] = smaller[k];
+            }
+        std::sort(smaller.begin()+start[i], smaller.begin()+e);
+    }
+    start[nbRegions] = e;
+    std::vector<int32_t>(smaller.begin(), smaller.begin()+e).swap(smaller);
+}
+
+#define INSTANTIATE(T, T0) \
+template RegionGraph::RegionGraph(const T*, int, int, const T0*, int);
+#define INSTANTIATE_ALL(T) \
+INSTANTIATE(T, uint8_t) \
+INSTANTIATE(T, uint16_t) \
+INSTANTIATE(T, float) \
+INSTANTIATE(T, double)
+INSTANTIATE_ALL(uint8_t)
+INSTANTIATE_ALL(uint16_t)
+INSTANTIATE_ALL(float)
+INSTANTIATE_ALL(double)
@@ -0,0 +1,41 @@
+#ifndef REGION_GRAPH_H
+#define REGION_GRAPH_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/// Region adjacency graph of an image, the graph of make_graph.m: the
+/// regions are the 4-connected components of constant gray level, and
+/// region i is linked to region j if they are adjacent and u is larger on i.
+/// The image has h rows and w columns in column major order, pixel (y,x)
+/// being at index x*h+y. The regions are numbered from 0 in the order of
+/// their first pixel, as by idcc_mex.
+///
+/// The regions are labelled, counted and the optional image \a u0 summed on
+/// them by connected_components() on \a nbThreads threads, then a single
+/// sweep of the pixels collects their pairs of adjacent pixels. The pairs
+/// are bucketed by larger region and deduplicated in each bucket, giving the
+/// edges in CSR form, sorted as the rows of unique(I,'rows') in make_graph.m.
+/// Pixels may be of type uint8_t, uint16_t, float or double.
+struct RegionGraph {
+    template <typename T, typename T0>
+    RegionGraph(const T* u, int h, int w, const T0* u0, int nbThreads = 1);
+
+    size_t size() const { return (size_t)nrow*ncol; } ///< Number of pixels
+    int edges() const { return start[nbRegions]; } ///< Number of edges
+
+    int nrow, ncol; ///< Dimensions of image
+    int nbRegions; ///< The number of regions
+
+    std::vector<int32_t> label; ///< Region of each pixel
+    std::vector<int32_t> count; ///< Number of pixels of each region
+    std::vector<double> sum; ///< Sum of u0 on each region, if u0 is given
+
+    /// Edges from region i to the smaller adjacent regions
+    /// smaller[start[i]] < ... < smaller[start[i+1]-1]
+    std::vector<int32_t> start;
+    std::vector<int32_t> smaller;
+};
+
+#endif
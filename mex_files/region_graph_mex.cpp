@@ -0,0 +1,117 @@
+#include "region_graph.h"
+#include "parallel.h"
+#include <stdint.h>
+#include "mex.h"
+
+// Graph of the image \a u, whose pixels are of type T, with the sums of
+// \a u0 of any class if not null, \a ok being set to false for an
+// unsupported class of u0
+template <typename T>
+RegionGraph* CreateGraph(const T* u, int h, int w, const mxArray* u0, bool& ok)
+{
+    ok = true;
+    const int nbThreads = default_threads();
+    if (!u0) {return new RegionGraph(u, h, w, (const double*)0, nbThreads);}
+    switch (mxGetClassID(u0)) {
+        case mxUINT8_CLASS : return new RegionGraph(u, h, w, (const uint8_t*)mxGetData(u0), nbThreads);
+        case mxUINT16_CLASS : return new RegionGraph(u, h, w, (const uint16_t*)mxGetData(u0), nbThreads);
+        case mxSINGLE_CLASS : return new RegionGraph(u, h, w, (const float*)mxGetData(u0), nbThreads);
+        case mxDOUBLE_CLASS : return new RegionGraph(u, h, w, (const double*)mxGetData(u0), nbThreads);
+        default: ok = false;
+    }
+    return 0;
+}
+
+// Entry point for Matlab
+//
+// Native version of make_graph.m: connected components of an image in
+// 4-connexity, labelled as by idcc_mex, and their adjacency graph, computed
+// in one call on all the cores.
+//
+// Input:
+// u: image of class uint8, uint16, single or double
+// u0 (optional): image of the same size, of class uint8, uint16, single or
+// double, summed on the components
+//
+// Output:
+// uCC: the id of the connected component of each pixel of u, of class int32
+// E: edges of size Mx2, E(k,:)=[i,j] meaning that components i and j are
+// adjacent and u is larger on i, sorted by i then j. A of make_graph.m is
+// sparse([1:M,1:M],E(:),[ones(1,M),-ones(1,M)],M,N).
+// W: number of pixels of each component, of size Nx1
+// S: sum of u0 on each component, of size Nx1
+//
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // Ouput : uCC, E, W, S
+    // Input : u, u0
+
+    // Check for proper input
+    switch(nrhs) {
+        case 1 :
+        case 2 :
+            break;
+        default: mexErrMsgTxt("Bad number of inputs.\n");
+        break;
+    }
+    if (nlhs > 4) {mexErrMsgTxt("Too many outputs.\n");}
+    if (nlhs > 3 && nrhs < 2) {mexErrMsgTxt("S needs u0.\n");}
+    if (mxGetNumberOfDimensions(prhs[0]) > 2) {mexErrMsgTxt("u should be an image.\n");}
+
+    const int m = mxGetM(prhs[0]); //number of rows
+    const int n = mxGetN(prhs[0]); //number of columns
+    if ((double)m*n >= (1 << 30)) {mexErrMsgTxt("Image too large.\n");}
+    const mxArray* u0 = (nrhs > 1)? prhs[1]: 0;
+    if (u0 && mxGetNumberOfElements(u0) != (size_t)m*n) {mexErrMsgTxt("u and u0 should have the same size.\n");}
+
+    RegionGraph* graph = 0;
+    bool ok = true;
+    switch (mxGetClassID(prhs[0])) {
+        case mxUINT8_CLASS : graph = CreateGraph((const uint8_t*)mxGetData(prhs[0]), m, n, u0, ok); break;
+        case mxUINT16_CLASS : graph = CreateGraph((const uint16_t*)mxGetData(prhs[0]), m, n, u0, ok); break;
+        case mxSINGLE_CLASS : graph = CreateGraph((const float*)mxGetData(prhs[0]), m, n, u0, ok); break;
+        case mxDOUBLE_CLASS : graph = CreateGraph((const double*)mxGetData(prhs[0]), m, n, u0, ok); break;
+        default: mexErrMsgTxt("u should be of class uint8, uint16, single or double.\n");
+    }
+    if (!ok) {mexErrMsgTxt("u0 should be of class uint8, uint16, single or double.\n");}
+
+    // Create output arguments, numbered from 1
+    plhs[0] = mxCreateNumericMatrix(m,n,mxINT32_CLASS,mxREAL);
+    int32_t* idcc = (int32_t*)mxGetData(plhs[0]);
+    for (size_t p = 0; p < graph->size(); ++p)
+    {
+        idcc[p] = graph->label[p] + 1;
+    }
+    const int N = graph->nbRegions, M = graph->edges();
+    if (nlhs > 1)
+    {
+        plhs[1] = mxCreateDoubleMatrix(M,2,mxREAL);
+        double* E = mxGetPr(plhs[1]);
+        for (int i = 0; i < N; ++i)
+        {
+            for (int k = graph->start[i]; k < graph->start[i+1]; ++k)
+            {
+                E[k] = i + 1;
+                E[k+M] = graph->smaller[k] + 1;
+            }
+        }
+    }
+    if (nlhs > 2)
+    {
+        plhs[2] = mxCreateDoubleMatrix(N,1,mxREAL);
+        double* W = mxGetPr(plhs[2]);
+        for (int i = 0; i < N; ++i)
+        {
+            W[i] = graph->count[i];
+        }
+    }
+    if (nlhs > 3)
+    {
+        plhs[3] = mxCreateDoubleMatrix(N,1,mxREAL);
+        double* S = mxGetPr(plhs[3]);
+        for (int i = 0; i < N; ++i)
+        {
+            S[i] = graph->sum[i];
+        }
+    }
+    delete graph;
+}
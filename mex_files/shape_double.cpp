@@ -1,6 +1,47 @@
 #include "shape_double.h"
 #include <cassert>
 
+/// Freeman directions, y axis pointing down
+static const int FREEMAN_DX[8] = {1, 1, 0,-1,-1,-1, 0, 1};
+static const int FREEMAN_DY[8] = {0,-1,-1,-1, 0, 1, 1, 1};
+
+/// Remove all steps.
+void LsChainCode::clear() {
+    words.clear();
+    n = 0;
+}
+
+/// Append the step between points \a from and \a to, which are neighbors.
+void LsChainCode::push(LsPoint from, LsPoint to) {
+    int dx = to.x - from.x, dy = to.y - from.y;
+    uint64_t code = 0;
+    while(FREEMAN_DX[code] != dx || FREEMAN_DY[code] != dy) {
+        ++code;
+        assert(code < 8);
+    }
+    if(n % 21 == 0)
+        words.push_back(0);
+    words.back() |= code << (3*(n%21));
+    ++n;
+}
+
+/// Decode in \a curve the \a nbPoints points of a curve starting at
+/// \a start, whose steps are stored from index \a first.
+void LsChainCode::decode(LsPoint start, size_t first, LsIndex nbPoints,
+                         std::vector<LsPoint>& curve) const {
+    curve.clear();
+    if(nbPoints <= 0)
+        return;
+    curve.reserve(nbPoints);
+    curve.push_back(start);
+    for(size_t i = first; i+1 < first+nbPoints; i++) {
+        int code = (int)(words[i/21] >> (3*(i%21))) & 7;
+        start.x += FREEMAN_DX[code];
+        start.y += FREEMAN_DY[code];
+        curve.push_back(start);
+    }
+}
+
 /// Return in the subtree of root pShape a shape that is not removed
 static LsShape* ls_shape_of_subtree(LsShape* pShape) {
     LsShape* pShapeNotRemoved = 0;
@@ -33,21 +74,15 @@ LsShape* LsShape::find_child() {
 /// Find next sibling, taking into account that some shapes are removed
 LsShape* LsShape::find_sibling() {
     LsShape *pShape1 = 0, *pShape2 = 0;
-    // First look at the siblings in the original tree
-    for(pShape1 = sibling; pShape1 != 0; pShape1 = pShape1->sibling)
-        if((pShape2 = ls_shape_of_subtree(pShape1)) != 0)
-            return pShape2;
-    if(parent == 0 || ! parent->bIgnore)
-        return 0; // Parent in original tree is also parent in true tree: done
-    // Not found: find node in original tree just before the true parent
+    // Look at the siblings in the original tree, then at those of the removed
+    // ancestors up to the true parent
     LsShape* pShape = this;
-    do
+    do {
+        for(pShape1 = pShape->sibling; pShape1; pShape1 = pShape1->sibling)
+            if((pShape2 = ls_shape_of_subtree(pShape1)) != 0)
+                return pShape2;
         pShape = pShape->parent;
-    while(pShape->parent->bIgnore);
-    // Look at the siblings of this node
-    for(pShape1 = pShape->sibling; pShape1; pShape1 = pShape1->sibling)
-        if((pShape2 = ls_shape_of_subtree(pShape1)) != 0)
-            return pShape2;
+    } while(pShape && pShape->bIgnore);
     return 0;
 }
 
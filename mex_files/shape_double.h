@@ -1,11 +1,41 @@
 #ifndef SHAPE_H
 #define SHAPE_H
 #include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/// Types of the coordinates of pixels and of the indices of pixels and
+/// shapes. By default images are limited to 32767 pixels in width and height
+/// and to 2^31-1 pixels. Define LS_WIDE at compilation for 32-bit coordinates
+/// and 64-bit indices, doubling the size of pixel lists.
+#ifdef LS_WIDE
+typedef int32_t LsCoord;
+typedef int64_t LsIndex;
+#else
+typedef short int LsCoord;
+typedef int LsIndex;
+#endif
 
 /// Structure for a pixel, 2 coordinates in image plane.
 struct LsPoint {
-    short int x;
-    short int y;
+    LsCoord x;
+    LsCoord y;
+};
+
+/// Level lines stored as Freeman chain codes, 3 bits per step, packed in a
+/// single arena shared by all shapes.
+class LsChainCode {
+public:
+    LsChainCode(): n(0) {}
+    size_t size() const { return n; } ///< Number of steps stored
+    size_t memory() const { return words.capacity()*sizeof(uint64_t); }
+    void clear();
+    void push(LsPoint from, LsPoint to);
+    void decode(LsPoint start, size_t first, LsIndex nbPoints,
+                std::vector<LsPoint>& curve) const;
+private:
+    std::vector<uint64_t> words; ///< 21 steps per word
+    size_t n;
 };
 
 /// Structure for a shape (connected component of level set with filled holes)
@@ -16,12 +46,16 @@ struct LsShape {
     double gray; ///< Gray level of the level set
     bool bIgnore; ///< Should the shape be ignored?
     bool bBoundary; ///< Does the shape meets the border of the image?
-    int shapeId;
+    LsIndex shapeId; ///< Index in the tree
     
     LsPoint* pixels; ///< Array of pixels in shape
-    std::vector<LsPoint> contour; ///< Level line
 
-    int area; ///< Number of pixels in the shape
+    // Level line, only if requested at tree construction
+    LsIndex contourSize; ///< Number of points, 0 if not stored
+    LsPoint contourStart; ///< First point
+    size_t contourCode; ///< Index of first step in the tree chain code
+
+    LsIndex area; ///< Number of pixels in the shape
 
     // Tree structure
     LsShape* parent;  ///< Smallest containing shape
@@ -0,0 +1,108 @@
+#include "snr_global.h"
+#include "isotonic_regression_tree.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <stdint.h>
+
+// SNR of gu with respect to u0, from the squared norms of gu-u0 and u0
+static double snr(double err, double norm)
+{
+    return -10*std::log10(err/norm);
+}
+
+template <typename T, typename T0>
+double snr_global(const T* u, const T0* u0, size_t n, double* gu,
+                  std::vector<double>& levels, std::vector<double>& g)
+{
+    levels.clear();
+    std::vector<double> count, mean;
+    double err = 0, norm = 0;
+    if (std::numeric_limits<T>::is_integer && sizeof(T) <= 2)
+    {
+        // Histogram of u, with the sum of u0 on each gray level
+        std::vector<double> lut(size_t(1) << (8*sizeof(T)), 0);
+        std::vector<double> sum(lut.size(), 0);
+        for (size_t i = 0; i < n; ++i)
+        {
+            const size_t v = (size_t)u[i];
+            lut[v]++;
+            sum[v] += u0[i];
+        }
+        for (size_t v = 0; v < lut.size(); ++v)
+        {
+            if (lut[v] > 0)
+            {
+                levels.push_back((double)v);
+                count.push_back(lut[v]);
+                mean.push_back(sum[v]/lut[v]);
+            }
+        }
+        g.resize(levels.size());
+        isotonic_chain((int)levels.size(), count.data(), mean.data(), g.data());
+        // g of each gray level
+        for (size_t k = 0; k < levels.size(); ++k)
+        {
+            lut[(size_t)levels[k]] = g[k];
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            gu[i] = lut[(size_t)u[i]];
+            const double d = gu[i] - u0[i];
+            err += d*d;
+            norm += (double)u0[i]*u0[i];
+        }
+        return snr(err, norm);
+    }
+
+    // Pixels sorted by gray level, whose runs are the levels
+    std::vector<std::pair<T, size_t> > sorted(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        sorted[i] = std::make_pair(u[i], i);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<size_t> end; // End of the run of each level in sorted
+    for (size_t i = 0; i < n;)
+    {
+        const T v = sorted[i].first;
+        double sum = 0;
+        size_t j = i;
+        for (; j < n && sorted[j].first == v; ++j)
+        {
+            sum += u0[sorted[j].second];
+        }
+        levels.push_back((double)v);
+        count.push_back((double)(j - i));
+        mean.push_back(sum/(j - i));
+        end.push_back(j);
+        i = j;
+    }
+    g.resize(levels.size());
+    isotonic_chain((int)levels.size(), count.data(), mean.data(), g.data());
+    for (size_t k = 0, i = 0; k < levels.size(); ++k)
+    {
+        for (; i < end[k]; ++i)
+        {
+            const size_t p = sorted[i].second;
+            gu[p] = g[k];
+            const double d = g[k] - u0[p];
+            err += d*d;
+            norm += (double)u0[p]*u0[p];
+        }
+    }
+    return snr(err, norm);
+}
+
+#define INSTANTIATE(T, T0) \
+template double snr_global(const T*, const T0*, size_t, double*, \
+                           std::vector<double>&, std::vector<double>&);
+#define INSTANTIATE_ALL(T) \
+INSTANTIATE(T, uint8_t) \
+INSTANTIATE(T, uint16_t) \
+INSTANTIATE(T, float) \
+INSTANTIATE(T, double)
+INSTANTIATE_ALL(uint8_t)
+INSTANTIATE_ALL(uint16_t)
+INSTANTIATE_ALL(float)
+INSTANTIATE_ALL(double)
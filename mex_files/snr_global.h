@@ -0,0 +1,20 @@
+#ifndef SNR_GLOBAL_H
+#define SNR_GLOBAL_H
+
+#include <vector>
+#include <stddef.h>
+
+// Global contrast invariant SNR: projection of an image u0 on the images
+// g(u), g non decreasing, of an image u of n pixels.
+
+/// Non decreasing function \a g of the sorted gray \a levels of \a u
+/// minimizing ||g(u)-u0||_2, and image \a gu = g(u). The counts and sums of
+/// u0 on the levels are computed in one pass, in a histogram for 8 and 16
+/// bits images and on the sorted pixels otherwise, then solved by a weighted
+/// pool adjacent violators. Returns the SNR of gu with respect to u0. Pixels
+/// are of type uint8_t, uint16_t, float or double.
+template <typename T, typename T0>
+double snr_global(const T* u, const T0* u0, size_t n, double* gu,
+                  std::vector<double>& levels, std::vector<double>& g);
+
+#endif
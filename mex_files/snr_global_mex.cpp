@@ -0,0 +1,83 @@
+#include "snr_global.h"
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include "mex.h"
+
+// Global SNR of \a u, whose pixels are of type T, with respect to \a u0 of
+// any class, \a ok being set to false for an unsupported class of u0
+template <typename T>
+double SnrGlobal(const T* u, const mxArray* u0, size_t n, double* gu,
+                 std::vector<double>& levels, std::vector<double>& g, bool& ok)
+{
+    ok = true;
+    switch (mxGetClassID(u0)) {
+        case mxUINT8_CLASS : return snr_global(u, (const uint8_t*)mxGetData(u0), n, gu, levels, g);
+        case mxUINT16_CLASS : return snr_global(u, (const uint16_t*)mxGetData(u0), n, gu, levels, g);
+        case mxSINGLE_CLASS : return snr_global(u, (const float*)mxGetData(u0), n, gu, levels, g);
+        case mxDOUBLE_CLASS : return snr_global(u, (const double*)mxGetData(u0), n, gu, levels, g);
+        default: ok = false;
+    }
+    return 0;
+}
+
+// Entry point for Matlab
+//
+// Native version of SNR_global.m: projection of u0 on the images g(u), g non
+// decreasing. The counts and sums of u0 on the gray levels of u are computed
+// in one pass, in a histogram for 8 and 16 bits images and by sorting the
+// pixels otherwise, and the isotonic regression on the levels weighted by
+// their counts is solved by pool adjacent violators.
+//
+// Input:
+// u: image of class uint8, uint16, single or double
+// u0: reference image of the same size, of class uint8, uint16, single or
+// double
+//
+// Output:
+// gu: g(u), of class double
+// g: value of g at each gray level of u, sorted in increasing order
+// snr: SNR of gu with respect to u0
+// levels: the gray levels of u
+//
+void mexFunction( int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // Ouput : gu, g, snr, levels
+    // Input : u, u0
+    if (nrhs != 2) {mexErrMsgTxt("Bad number of inputs.\n");}
+    if (nlhs > 4) {mexErrMsgTxt("Too many outputs.\n");}
+    
+    const size_t n = mxGetNumberOfElements(prhs[0]);
+    if (mxGetNumberOfElements(prhs[1]) != n) {mexErrMsgTxt("u and u0 should have the same size.\n");}
+    if (n > 0x7FFFFFFF && mxGetClassID(prhs[0]) != mxUINT8_CLASS && mxGetClassID(prhs[0]) != mxUINT16_CLASS) {mexErrMsgTxt("u has too many pixels.\n");}
+    
+    plhs[0] = mxCreateNumericArray(mxGetNumberOfDimensions(prhs[0]), mxGetDimensions(prhs[0]), mxDOUBLE_CLASS, mxREAL);
+    double* gu = mxGetPr(plhs[0]);
+    
+    std::vector<double> levels, g;
+    double snr = 0;
+    bool ok = true;
+    switch (mxGetClassID(prhs[0])) {
+        case mxUINT8_CLASS : snr = SnrGlobal((const uint8_t*)mxGetData(prhs[0]), prhs[1], n, gu, levels, g, ok); break;
+        case mxUINT16_CLASS : snr = SnrGlobal((const uint16_t*)mxGetData(prhs[0]), prhs[1], n, gu, levels, g, ok); break;
+        case mxSINGLE_CLASS : snr = SnrGlobal((const float*)mxGetData(prhs[0]), prhs[1], n, gu, levels, g, ok); break;
+        case mxDOUBLE_CLASS : snr = SnrGlobal((const double*)mxGetData(prhs[0]), prhs[1], n, gu, levels, g, ok); break;
+        default: mexErrMsgTxt("u should be of class uint8, uint16, single or double.\n");
+    }
+    if (!ok) {mexErrMsgTxt("u0 should be of class uint8, uint16, single or double.\n");}
+    
+    const size_t N = levels.size();
+    if (nlhs > 1)
+    {
+        plhs[1] = mxCreateDoubleMatrix(N,1,mxREAL);
+        std::copy(g.begin(), g.end(), mxGetPr(plhs[1]));
+    }
+    if (nlhs > 2)
+    {
+        plhs[2] = mxCreateDoubleScalar(snr);
+    }
+    if (nlhs > 3)
+    {
+        plhs[3] = mxCreateDoubleMatrix(N,1,mxREAL);
+        std::copy(levels.begin(), levels.end(), mxGetPr(plhs[3]));
+    }
+}
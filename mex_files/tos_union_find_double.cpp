@@ -0,0 +1,574 @@
+#include "tos_union_find_double.h"
+#include "tree_double.h"
+#include "parallel.h"
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <stdint.h>
+#include <limits>
+
+typedef uint32_t Face; ///< Index of a face in the Khalimsky grid
+static const uint32_t UNDEF = 0xFFFFFFFF;
+static const uint32_t USED = 0xFFFFFFFE;
+
+/// Index of lowest set bit of \a x, which must be nonzero.
+inline int lowest_bit(uint64_t x) {
+#ifdef __GNUC__
+    return __builtin_ctzll(x);
+#else
+    int i = 0;
+    for(; !(x & 1); x >>= 1) ++i;
+    return i;
+#endif
+}
+
+/// Index of highest set bit of \a x, which must be nonzero.
+inline int highest_bit(uint64_t x) {
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(x);
+#else
+    int i = 0;
+    for(; x >>= 1;) ++i;
+    return i;
+#endif
+}
+
+/// Set of levels, with fast search of the nearest element above or below.
+/// Bits are stored in layers, each bit of a layer telling whether the
+/// corresponding word of the layer below is nonzero.
+class LevelSet {
+public:
+    explicit LevelSet(size_t n);
+    void insert(size_t i);
+    void erase(size_t i);
+    long next(size_t i) const; ///< Smallest element >= i, -1 if none
+    long prev(size_t i) const; ///< Largest element <= i, -1 if none
+private:
+    std::vector< std::vector<uint64_t> > layers;
+};
+
+LevelSet::LevelSet(size_t n) {
+    do {
+        n = (n+63) / 64;
+        layers.push_back(std::vector<uint64_t>(n, 0));
+    } while(n > 1);
+}
+
+void LevelSet::insert(size_t i) {
+    for(size_t k = 0; k < layers.size(); k++, i >>= 6) {
+        uint64_t& word = layers[k][i>>6];
+        bool wasEmpty = (word == 0);
+        word |= uint64_t(1) << (i&63);
+        if(! wasEmpty)
+            break;
+    }
+}
+
+void LevelSet::erase(size_t i) {
+    for(size_t k = 0; k < layers.size(); k++, i >>= 6) {
+        uint64_t& word = layers[k][i>>6];
+        word &= ~(uint64_t(1) << (i&63));
+        if(word != 0)
+            break;
+    }
+}
+
+long LevelSet::next(size_t i) const {
+    size_t k = 0;
+    for(;; k++) {
+        if(k == layers.size() || (i>>6) >= layers[k].size())
+            return -1;
+        uint64_t bits = layers[k][i>>6] & (~uint64_t(0) << (i&63));
+        if(bits) {
+            i = (i & ~size_t(63)) | lowest_bit(bits);
+            break;
+        }
+        i = (i>>6) + 1;
+    }
+    while(k-- > 0)
+        i = (i<<6) | lowest_bit(layers[k][i]);
+    return (long)i;
+}
+
+long LevelSet::prev(size_t i) const {
+    size_t k = 0;
+    for(;; k++) {
+        if(k == layers.size())
+            return -1;
+        uint64_t mask = ((i&63) == 63)? ~uint64_t(0):
+            (uint64_t(1) << ((i&63)+1)) - 1;
+        uint64_t bits = layers[k][i>>6] & mask;
+        if(bits) {
+            i = (i & ~size_t(63)) | highest_bit(bits);
+            break;
+        }
+        if((i>>6) == 0)
+            return -1;
+        i = (i>>6) - 1;
+    }
+    while(k-- > 0)
+        i = (i<<6) | highest_bit(layers[k][i]);
+    return (long)i;
+}
+
+/// The image immersed in the Khalimsky grid.
+/// The image, surrounded by a frame at the minimum of its border, is first
+/// subdivided with the max interpolation, which is well-composed and whose
+/// tree of shapes is the one with 4-connected lower and 8-connected upper
+/// level sets. Its elements become the 2-faces of the Khalimsky grid, whose
+/// other faces hold the span of their adjacent 2-faces. A volume is handled
+/// the same way in 3D, giving 6-connected lower and 26-connected upper level
+/// sets.
+struct Immersion {
+    template <typename T>
+    Immersion(const T* gray, int w, int h, int d);
+    void span(Face f, uint32_t& lower, uint32_t& upper) const;
+    Face pixel(int x, int y, int z) const ///< Top face of pixel (\a x,\a y,\a z)
+    { return (((kdep>1)? (4*z+5)*krow: 0) + 4*y+5)*kcol + 4*x+5; }
+
+    int mrow, mcol, mdep; ///< Dimensions of the max interpolation
+    int krow, kcol, kdep; ///< Dimensions of the Khalimsky grid
+    Face kslice; ///< Number of faces in a slice of the grid
+    /// Layers of the grid: rows for an image, slices for a volume
+    int nlayer; Face layer;
+    std::vector<double> values; ///< Sorted gray levels
+    std::vector<uint32_t> m; ///< Max interpolation, as indices in \c values
+};
+
+template <typename T>
+Immersion::Immersion(const T* gray, int w, int h, int d)
+: mrow(2*(h+2)-1), mcol(2*(w+2)-1), mdep((d>1)? 2*(d+2)-1: 1),
+  krow(2*mrow+1), kcol(2*mcol+1), kdep((d>1)? 2*mdep+1: 1),
+  kslice((Face)krow*kcol) {
+    nlayer = (kdep>1)? kdep: krow;
+    layer = (kdep>1)? kslice: kcol;
+    size_t n = (size_t)w*h*d;
+    std::vector<uint32_t> lut; // Index of each value, for 8 and 16 bits
+    if(std::numeric_limits<T>::is_integer && sizeof(T) <= 2) {
+        lut.assign(size_t(1) << (8*sizeof(T)), 0);
+        for(size_t i = 0; i < n; i++)
+            lut[(size_t)gray[i]] = 1;
+        for(size_t v = 0; v < lut.size(); v++)
+            if(lut[v]) {
+                lut[v] = (uint32_t)values.size();
+                values.push_back((double)v);
+            }
+    } else {
+        values.assign(gray, gray+n);
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()),
+                     values.end());
+    }
+    #define INDEX(v) (lut.empty()? (uint32_t)(std::lower_bound(values.begin(),\
+        values.end(), (double)(v)) - values.begin()): lut[(size_t)(v)])
+
+    // Frame at the minimum of the border
+    T border = gray[0];
+    for(int z = 0; z < d; z++)
+        for(int y = 0; y < h; y++) {
+            const T* row = gray + ((size_t)z*h+y)*w;
+            if(d > 1 && (z == 0 || z+1 == d))
+                border = std::min(border, *std::min_element(row, row+w));
+            else if(y == 0 || y+1 == h)
+                border = std::min(border, *std::min_element(row, row+w));
+            else
+                border = std::min(border, std::min(row[0], row[w-1]));
+        }
+    uint32_t frame = INDEX(border);
+
+    size_t mslice = (size_t)mrow*mcol;
+    m.assign(mslice*mdep, frame);
+    for(int z = 0; z < d; z++) {
+        uint32_t* slice = &m[((mdep>1)? 2*(z+1): 0) * mslice];
+        for(int y = 0; y < h; y++)
+            for(int x = 0; x < w; x++)
+                slice[2*(y+1)*mcol + 2*(x+1)] =
+                    INDEX(gray[((size_t)z*h+y)*w+x]);
+    }
+    for(int k = 0; k < mdep; k += 2) {
+        uint32_t* slice = &m[k*mslice];
+        for(int i = 0; i < mrow; i += 2) // Horizontal edges
+            for(int j = 1; j < mcol; j += 2)
+                slice[i*mcol+j] = std::max(slice[i*mcol+j-1],
+                                           slice[i*mcol+j+1]);
+        for(int i = 1; i < mrow; i += 2) // Vertical edges and vertices
+            for(int j = 0; j < mcol; j++)
+                slice[i*mcol+j] = std::max(slice[(i-1)*mcol+j],
+                                           slice[(i+1)*mcol+j]);
+    }
+    for(int k = 1; k < mdep; k += 2) // Elements between slices
+        for(size_t i = 0; i < mslice; i++)
+            m[k*mslice+i] = std::max(m[(k-1)*mslice+i], m[(k+1)*mslice+i]);
+    #undef INDEX
+}
+
+/// Span of values of face \a f, as indices in \c values.
+void Immersion::span(Face f, uint32_t& lower, uint32_t& upper) const {
+    int z = f / kslice, r = (f % kslice) / kcol, c = f % kcol;
+    int z0 = (z-1)>>1, z1 = z>>1, r0 = (r-1)>>1, r1 = r>>1;
+    int c0 = (c-1)>>1, c1 = c>>1;
+    z0 = std::max(z0, 0); z1 = std::min(z1, mdep-1);
+    r0 = std::max(r0, 0); r1 = std::min(r1, mrow-1);
+    c0 = std::max(c0, 0); c1 = std::min(c1, mcol-1);
+    lower = upper = m[((size_t)z0*mrow+r0)*mcol+c0];
+    for(int k = z0; k <= z1; k++)
+        for(int i = r0; i <= r1; i++)
+            for(int j = c0; j <= c1; j++) {
+                uint32_t v = m[((size_t)k*mrow+i)*mcol+j];
+                lower = std::min(lower, v);
+                upper = std::max(upper, v);
+            }
+}
+
+/// The 4 neighbors of face \a f, or 6 in a volume, \a n is filled and
+/// their number returned.
+inline int neighbors(const Immersion& im, Face f, Face n[6]) {
+    Face rc = (im.kdep > 1)? f % im.kslice: f;
+    int k = 0, r = rc / im.kcol, c = rc % im.kcol;
+    if(c > 0)          n[k++] = f-1;
+    if(c+1 < im.kcol)  n[k++] = f+1;
+    if(r > 0)          n[k++] = f-im.kcol;
+    if(r+1 < im.krow)  n[k++] = f+im.kcol;
+    if(im.kdep > 1) {
+        int z = f / im.kslice;
+        if(z > 0)          n[k++] = f-im.kslice;
+        if(z+1 < im.kdep)  n[k++] = f+im.kslice;
+    }
+    return k;
+}
+
+/// Order faces by propagation from the exterior, with a hierarchical queue
+/// whose current level is changed to the closest nonempty one only when
+/// exhausted. \a level is set to the level given to each face.
+static void sort_faces(const Immersion& im, std::vector<Face>& R,
+                       std::vector<uint32_t>& level) {
+    size_t nLevels = im.values.size();
+    std::vector< std::vector<Face> > q(nLevels);
+    LevelSet nonEmpty(nLevels);
+
+    level.assign((size_t)im.kslice*im.kdep, UNDEF);
+    R.clear();
+    R.reserve(level.size());
+    uint32_t l = im.m[0];
+    level[0] = l;
+    q[l].push_back(0);
+    nonEmpty.insert(l);
+    for(size_t queued = 1; queued > 0; queued--) {
+        if(q[l].empty()) {
+            long up = nonEmpty.next(l), down = nonEmpty.prev(l);
+            l = (up < 0 || (down >= 0 && l-down < up-l))? down: up;
+        }
+        Face f = q[l].back();
+        q[l].pop_back();
+        if(q[l].empty())
+            nonEmpty.erase(l);
+        R.push_back(f);
+
+        Face n[6];
+        for(int k = neighbors(im, f, n)-1; k >= 0; k--) {
+            if(level[n[k]] != UNDEF)
+                continue;
+            uint32_t lower, upper;
+            im.span(n[k], lower, upper);
+            uint32_t ln = (lower > l)? lower: (upper < l)? upper: l;
+            level[n[k]] = ln;
+            if(q[ln].empty())
+                nonEmpty.insert(ln);
+            q[ln].push_back(n[k]);
+            queued++;
+        }
+    }
+}
+
+/// Root of the set of \a f in the union-find forest \a zpar.
+inline Face find_root(std::vector<Face>& zpar, Face f) {
+    Face r = f;
+    while(zpar[r] != r)
+        r = zpar[r];
+    while(zpar[f] != r) { // Path compression
+        Face next = zpar[f];
+        zpar[f] = r;
+        f = next;
+    }
+    return r;
+}
+
+/// Union-find in reverse propagation order. Each face is its own node in the
+/// resulting tree \a par.
+static void union_find(const Immersion& im, const std::vector<Face>& R,
+                       std::vector<Face>& par, std::vector<Face>& zpar) {
+    std::fill(zpar.begin(), zpar.end(), UNDEF);
+    for(size_t i = R.size(); i-- > 0;) {
+        Face f = R[i];
+        par[f] = zpar[f] = f;
+        Face nb[6];
+        for(int k = neighbors(im, f, nb)-1; k >= 0; k--)
+            if(zpar[nb[k]] != UNDEF) {
+                Face r = find_root(zpar, nb[k]);
+                if(r != f)
+                    par[r] = zpar[r] = f;
+            }
+    }
+}
+
+/// First face of the flat zone of \a f in the tree \a par, of lowest rank,
+/// the faces of its path to it being linked to it directly.
+inline Face level_root(std::vector<Face>& par,
+                       const std::vector<uint32_t>& level, Face f) {
+    Face r = f;
+    while(par[r] != r && level[par[r]] == level[r])
+        r = par[r];
+    while(f != r) { // Path compression
+        Face next = par[f];
+        par[f] = r;
+        f = next;
+    }
+    return r;
+}
+
+/// Merge the branches of adjacent faces \a x and \a y in the tree \a par,
+/// whose faces are ordered by \a rank. See Wilkinson et al., "Concurrent
+/// computation of attribute filters on shared memory parallel machines",
+/// PAMI 2008. The branches are walked through the roots of their flat
+/// zones, so that a flat zone is crossed once and not face by face.
+static void connect(std::vector<Face>& par, const std::vector<Face>& rank,
+                    const std::vector<uint32_t>& level, Face x, Face y) {
+    x = level_root(par, level, x);
+    y = level_root(par, level, y);
+    if(rank[x] < rank[y])
+        std::swap(x, y);
+    while(x != y) { // x is deeper than y
+        if(par[x] == x) {
+            par[x] = y;
+            break;
+        }
+        Face z = level_root(par, level, par[x]);
+        if(rank[z] > rank[y])
+            x = z;
+        else { // Insert y between x and z
+            par[x] = y;
+            x = y;
+            y = z;
+        }
+    }
+}
+
+/// Same result as \c union_find, on \a nbThreads threads, \a level being the
+/// level of each face. The grid is cut in tiles made of consecutive layers,
+/// whose trees are computed in parallel, then merged two by two along their
+/// borders. On return \a zpar holds the rank of faces.
+static void parallel_union_find(const Immersion& im,
+                                const std::vector<Face>& R,
+                                std::vector<Face>& par,
+                                const std::vector<uint32_t>& level,
+                                std::vector<Face>& zpar, int nbThreads) {
+    size_t n = R.size();
+    int nbTiles = std::min(nbThreads, im.nlayer);
+    std::vector<Face> first(nbTiles+1); // First face of each tile
+    std::vector<int> tile(im.nlayer); // Tile of each layer
+    for(int t = 0; t < nbTiles; t++) {
+        int l0 = (int)((size_t)t*im.nlayer/nbTiles);
+        int l1 = (int)((size_t)(t+1)*im.nlayer/nbTiles);
+        std::fill(tile.begin()+l0, tile.begin()+l1, t);
+        first[t] = (Face)l0 * im.layer;
+    }
+    first[nbTiles] = (Face)im.nlayer * im.layer;
+    #define TILE(f) tile[(f)/im.layer]
+
+    // Faces of each tile in propagation order, R being cut in chunks
+    std::vector<size_t> count(nbThreads*nbTiles, 0);
+    parallel_for(nbThreads, nbThreads, [&](int c) {
+        size_t* cnt = &count[c*nbTiles];
+        for(size_t i = c*n/nbThreads; i < (c+1)*n/nbThreads; i++)
+            cnt[TILE(R[i])]++;
+    });
+    std::vector<size_t> begin(nbTiles+1, n);
+    size_t i = 0;
+    for(int t = 0; t < nbTiles; t++) {
+        begin[t] = i;
+        for(int c = 0; c < nbThreads; c++) {
+            size_t k = count[c*nbTiles+t];
+            count[c*nbTiles+t] = i;
+            i += k;
+        }
+    }
+    std::vector<Face> order(n);
+    parallel_for(nbThreads, nbThreads, [&](int c) {
+        size_t* pos = &count[c*nbTiles];
+        for(size_t i = c*n/nbThreads; i < (c+1)*n/nbThreads; i++)
+            order[pos[TILE(R[i])]++] = R[i];
+    });
+    #undef TILE
+
+    // Trees of tiles, ignoring neighbors in other tiles
+    parallel_for(nbTiles, nbThreads, [&](int t) {
+        std::fill(zpar.begin()+first[t], zpar.begin()+first[t+1], UNDEF);
+        for(size_t i = begin[t+1]; i-- > begin[t];) {
+            Face f = order[i];
+            par[f] = zpar[f] = f;
+            Face nb[6];
+            for(int k = neighbors(im, f, nb)-1; k >= 0; k--)
+                if(first[t] <= nb[k] && nb[k] < first[t+1] &&
+                   zpar[nb[k]] != UNDEF) {
+                    Face r = find_root(zpar, nb[k]);
+                    if(r != f)
+                        par[r] = zpar[r] = f;
+                }
+        }
+    });
+
+    std::vector<Face>& rank = zpar;
+    parallel_for(nbThreads, nbThreads, [&](int c) {
+        for(size_t i = c*n/nbThreads; i < (c+1)*n/nbThreads; i++)
+            rank[R[i]] = (Face)i;
+    });
+
+    // Merge groups of tiles along their borders, disjoint groups in parallel
+    for(int step = 1; step < nbTiles; step *= 2)
+        parallel_for((nbTiles-step + 2*step-1) / (2*step), nbThreads,
+                     [&](int k) {
+            Face row = first[2*step*k + step];
+            for(Face f = row; f < row + im.layer; f++)
+                connect(par, rank, level, f - im.layer, f);
+        });
+}
+
+size_t tos_union_find_faces(int w, int h, int d) {
+    size_t n = (4*(size_t)w+7) * (4*(size_t)h+7);
+    return (d > 1)? n*(4*(size_t)d+7): n;
+}
+
+template <typename T>
+void tos_union_find(const T* gray, int w, int h,
+                    std::vector<int>& parent, std::vector<double>& level,
+                    int* node, int nbThreads) {
+    tos_union_find(gray, w, h, 1, parent, level, node, nbThreads);
+}
+
+template <typename T>
+void tos_union_find(const T* gray, int w, int h, int d,
+                    std::vector<int>& parent, std::vector<double>& level,
+                    int* node, int nbThreads) {
+    assert(tos_union_find_faces(w, h, d) < USED);
+    Immersion im(gray, w, h, d);
+    std::vector<Face> R;
+    std::vector<uint32_t> lvl;
+    sort_faces(im, R, lvl);
+    size_t n = R.size();
+
+    std::vector<Face> par(n), zpar(n);
+    if(nbThreads > 1)
+        parallel_union_find(im, R, par, lvl, zpar, nbThreads);
+    else
+        union_find(im, R, par, zpar);
+
+    // Canonicalization: parent of each face is the first face of its node
+    for(size_t i = 0; i < n; i++) {
+        Face f = R[i], p = par[f];
+        if(lvl[par[p]] == lvl[p])
+            par[f] = par[p];
+    }
+    Face root = R[0];
+    #define CANONICAL(f) ((f)==root || lvl[par[f]]!=lvl[f])
+    #define NODE_OF(f) (CANONICAL(f)? (f): par[f])
+
+    // Number nodes containing pixels, others are merged with their parent
+    std::vector<Face>& id = zpar;
+    std::fill(id.begin(), id.end(), UNDEF);
+    for(int z = 0; z < d; z++)
+        for(int y = 0; y < h; y++)
+            for(int x = 0; x < w; x++)
+                id[NODE_OF(im.pixel(x,y,z))] = USED;
+    parent.clear();
+    level.clear();
+    for(size_t i = 0; i < n; i++) {
+        Face f = R[i];
+        if(! CANONICAL(f))
+            continue;
+        if(id[f] == USED) {
+            parent.push_back((f==root)? -1: (int)id[par[f]]);
+            level.push_back(im.values[lvl[f]]);
+            id[f] = (Face)(parent.size()-1);
+        } else {
+            assert(f != root);
+            id[f] = id[par[f]];
+        }
+    }
+    for(int z = 0, i = 0; z < d; z++)
+        for(int y = 0; y < h; y++)
+            for(int x = 0; x < w; x++, i++)
+                node[i] = id[NODE_OF(im.pixel(x,y,z))];
+    #undef NODE_OF
+    #undef CANONICAL
+}
+
+/// Union-find algo: fill the shapes from the nodes of \c tos_union_find.
+template <typename T>
+void LsTree::flst_uf(const T* gray, int nbThreads) {
+    int area = ncol * nrow;
+    std::vector<int> node(area), parent;
+    std::vector<double> level;
+    tos_union_find(gray, ncol, nrow, parent, level, &node[0], nbThreads);
+    iNbShapes = (int)parent.size();
+    reserve(iNbShapes);
+
+    for(int i = 0; i < iNbShapes; i++) {
+        LsShape& s = shape(i);
+        s.shapeId = i;
+        s.gray = level[i];
+        s.bIgnore = false;
+        s.bBoundary = false;
+        s.area = 0;
+        s.contourSize = 0;
+        s.child = s.sibling = 0;
+        s.parent = (parent[i] < 0)? 0: &shape(parent[i]);
+        if(s.parent == 0)
+            s.type = LsShape::SUP;
+        else {
+            s.type = (s.gray < s.parent->gray)? LsShape::INF: LsShape::SUP;
+            s.sibling = s.parent->child;
+            s.parent->child = &s;
+        }
+    }
+    for(int i = 0; i < area; i++) {
+        LsShape& s = shape(node[i]);
+        smallestShape[i] = &s;
+        s.area++;
+        int x = i % ncol, y = i / ncol;
+        if(x == 0 || y == 0 || x+1 == ncol || y+1 == nrow)
+            s.bBoundary = true;
+    }
+
+    // Pixels of a shape: its private area followed by those of its children
+    std::vector<int> fill(iNbShapes);
+    for(int i = 0; i < iNbShapes; i++)
+        fill[i] = shape(i).area; // Private area for now
+    for(int i = iNbShapes-1; i > 0; i--)
+        shape(i).parent->area += shape(i).area;
+    for(int i = 0; i < iNbShapes; i++) {
+        LsPoint* next = shape(i).pixels + fill[i];
+        fill[i] = 0;
+        for(LsShape* c = shape(i).child; c; c = c->sibling) {
+            c->pixels = next;
+            next += c->area;
+        }
+    }
+    for(int i = 0; i < area; i++) {
+        LsShape& s = shape(node[i]);
+        LsPoint& pt = s.pixels[fill[node[i]]++];
+        pt.x = (LsCoord)(i % ncol);
+        pt.y = (LsCoord)(i / ncol);
+    }
+}
+
+#define INSTANTIATE(T) \
+template void tos_union_find(const T*, int, int, std::vector<int>&, \
+                             std::vector<double>&, int*, int); \
+template void tos_union_find(const T*, int, int, int, std::vector<int>&, \
+                             std::vector<double>&, int*, int); \
+template void LsTree::flst_uf(const T*, int);
+INSTANTIATE(uint8_t)
+INSTANTIATE(uint16_t)
+INSTANTIATE(float)
+INSTANTIATE(double)
+#undef INSTANTIATE
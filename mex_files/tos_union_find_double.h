@@ -0,0 +1,37 @@
+#ifndef TOS_UNION_FIND_H
+#define TOS_UNION_FIND_H
+
+#include <vector>
+#include <cstddef>
+
+/// Tree of shapes by immersion and union-find.
+/// Quasi-linear alternative to the FLST, computing the same tree (4-connected
+/// lower and 8-connected upper level sets, image surrounded by the minimum of
+/// its border). See Geraud, Carlinet, Crozet, Najman, "A quasi-linear
+/// algorithm to compute the tree of shapes of n-D images", ISMM 2013.
+/// \param gray the input image, of size \a w x \a h in row major order. Its
+/// type is uint8_t, uint16_t, float or double.
+/// \param parent output, parent node of each node, -1 for the root.
+/// \param level output, gray level of each node.
+/// \param node output, node of each pixel (array of size \a w x \a h).
+/// \param nbThreads number of threads for the union-find step. The sort
+/// step, a propagation with a hierarchical queue, remains sequential.
+/// Node 0 is the root and each node comes after its parent.
+template <typename T>
+void tos_union_find(const T* gray, int w, int h,
+                    std::vector<int>& parent, std::vector<double>& level,
+                    int* node, int nbThreads = 1);
+
+/// Same for a volume of size \a w x \a h x \a d, with 6-connected lower
+/// and 26-connected upper level sets.
+template <typename T>
+void tos_union_find(const T* gray, int w, int h, int d,
+                    std::vector<int>& parent, std::vector<double>& level,
+                    int* node, int nbThreads = 1);
+
+/// Number of faces of the grid in which \c tos_union_find immerses the
+/// image (\a d = 1) or the volume, about 64 per voxel. It must be below
+/// 2^32-2, and each face takes 20 bytes.
+size_t tos_union_find_faces(int w, int h, int d = 1);
+
+#endif
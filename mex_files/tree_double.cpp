@@ -1,64 +1,235 @@
 #include "tree_double.h"
+#include "tos_union_find_double.h"
+#include "parallel.h"
 #include <cassert>
 #include <iostream>
 #include <limits>
+#include <stdint.h>
 
-#define MAX 1e100
+/// Constructor of an empty tree, to be computed by \c reset().
+LsTree::LsTree()
+: ncol(0), nrow(0), iNbShapes(0), bContours(false) {}
 
-/// Constructor.
-LsTree::LsTree(const double* gray, int w, int h) {
+/// Constructor. All algorithms build the same tree, \c UNION_FIND is
+/// quasi-linear but does not extract the contours of the shapes, and
+/// \c PARALLEL is the same on all cores. Contours are stored only if
+/// \a bContours is set.
+template <typename T>
+LsTree::LsTree(const T* gray, int w, int h, Algo algo, bool bContours)
+: ncol(0), nrow(0), iNbShapes(0), bContours(false) {
+    reset(gray, w, h, algo, bContours);
+}
+
+/// Compute the tree of a new image, as the constructor does. The storage of
+/// the previous tree is reused: nothing is allocated if neither the number
+/// of pixels nor the number of shapes is larger than before.
+template <typename T>
+void LsTree::reset(const T* gray, int w, int h, Algo algo, bool bContours) {
+    assert(supports(w, h, algo));
     nrow = h; ncol = w;
-    
-    // Set the root of the tree. #shapes <= #pixels
-    LsShape* pRoot = shapes = new LsShape[nrow*ncol];
-    pRoot->type = LsShape::INF; pRoot->gray = MAX;
+    const LsIndex area = (LsIndex)nrow*ncol;
+    this->bContours = (bContours && algo == FLST);
+    contours.clear();
+    allPixels.resize(area);
+    smallestShape.resize(area);
+
+    // Set the root of the tree
+    iNbShapes = 0;
+    LsShape* pRoot = new_shape();
+    pRoot->type = LsShape::INF;
+    pRoot->gray = std::numeric_limits<double>::infinity();
     pRoot->bBoundary = true;
     pRoot->bIgnore = false;
-    pRoot->area = nrow*ncol;
+    pRoot->area = area;
     pRoot->parent = pRoot->sibling = pRoot->child = 0;
-    pRoot->pixels = 0;
-    iNbShapes = 1;
+    pRoot->pixels = &allPixels[0];
+    pRoot->contourSize = 0;
 
-    smallestShape = new LsShape*[ncol*nrow];
-    for(int i = ncol*nrow-1; i >= 0; i--)
+    for(LsIndex i = area-1; i >= 0; i--)
         smallestShape[i] = pRoot;
 
-    flst_td(gray);
+    if(algo == UNION_FIND)
+        flst_uf(gray, 1);
+    else if(algo == PARALLEL)
+        flst_uf(gray, default_threads());
+    else
+        flst_td(gray);
 }
 
+#define INSTANTIATE(T) \
+template LsTree::LsTree(const T*, int, int, Algo, bool); \
+template void LsTree::reset(const T*, int, int, Algo, bool);
+INSTANTIATE(uint8_t)
+INSTANTIATE(uint16_t)
+INSTANTIATE(float)
+INSTANTIATE(double)
+#undef INSTANTIATE
+
 /// Destructor.
 LsTree::~LsTree() {
-    if(shapes && iNbShapes > 0)
-        delete [] shapes[0].pixels;
-    delete [] shapes;
-    delete [] smallestShape;
+    for(size_t i = 0; i < chunks.size(); i++)
+        delete [] chunks[i];
+}
+
+/// Append a shape to the tree, only its index being set.
+LsShape* LsTree::new_shape() {
+    reserve(iNbShapes+1);
+    LsShape* s = &shape(iNbShapes);
+    s->shapeId = iNbShapes++;
+    return s;
+}
+
+/// Allocate the chunks to store \a nbShapes shapes.
+void LsTree::reserve(LsIndex nbShapes) {
+    while((LsIndex)chunks.size() << CHUNK_BITS < nbShapes)
+        chunks.push_back(new LsShape[1 << CHUNK_BITS]);
+}
+
+/// Number of bytes allocated by the tree, shapes, pixels and contours.
+size_t LsTree::memory() const {
+    return (chunks.size() << CHUNK_BITS) * sizeof(LsShape) +
+        allPixels.capacity() * sizeof(LsPoint) +
+        smallestShape.capacity() * sizeof(LsShape*) +
+        contours.memory();
+}
+
+/// Can the tree of an image of size \a w x \a h be computed by \a algo?
+/// Coordinates must fit in \c LsCoord and pixel indices in \c LsIndex. The
+/// union-find algorithms are further limited by the number of faces of their
+/// grid, which must fit in 32 bits.
+bool LsTree::supports(size_t w, size_t h, Algo algo) {
+    const size_t maxCoord = std::numeric_limits<LsCoord>::max();
+    const size_t maxIndex = std::numeric_limits<LsIndex>::max();
+    if(w > maxCoord || h > maxCoord || (w && h > maxIndex/w))
+        return false;
+    return (algo == FLST || tos_union_find_faces((int)w, (int)h) < 0xFFFFFFFE);
+}
+
+/// Estimate of the peak number of bytes used to compute with \a algo the
+/// tree of an image of size \a w x \a h having \a nbShapes shapes, at most
+/// w*h. Contours are not counted.
+size_t LsTree::memory_estimate(size_t w, size_t h, size_t nbShapes,
+                               Algo algo) {
+    const size_t area = w*h, chunk = (size_t)1 << CHUNK_BITS;
+    size_t bytes = (nbShapes+chunk-1)/chunk*chunk * sizeof(LsShape) +
+        area * (sizeof(LsPoint)+sizeof(LsShape*));
+    if(algo == FLST) // Seed edgels of the work list, at most one per shape
+        bytes += nbShapes * 2*sizeof(LsPoint);
+    else // Grid of the immersion, nodes of pixels, parents and levels
+        bytes += tos_union_find_faces((int)w, (int)h) * 20 +
+            area * sizeof(int) + nbShapes * (sizeof(int)+sizeof(double));
+    return bytes;
 }
 
 /// Reconstruct an image from the tree
 double* LsTree::build_image() const {
-    double* gray = new double[nrow*ncol];
-    double* out = gray;
-    LsShape** ppShape = smallestShape;
-    for(int i = nrow*ncol-1; i >= 0; i--) {
-        LsShape* pShape = *ppShape++;
+    double* gray = new double[(size_t)nrow*ncol];
+    build_image(gray);
+    return gray;
+}
+
+/// Reconstruct an image from the tree in \a out, of size \c ncol x \c nrow.
+template <typename T>
+void LsTree::build_image(T* out) const {
+    const LsIndex area = (LsIndex)nrow*ncol;
+    for(LsIndex i = 0; i < area; i++) {
+        LsShape* pShape = smallestShape[i];
         while(pShape->bIgnore)
             pShape = pShape->parent;
-        *out++ = pShape->gray;
+        *out++ = (T)pShape->gray;
     }
-    return gray;
+}
+
+template void LsTree::build_image(uint8_t* out) const;
+template void LsTree::build_image(uint16_t* out) const;
+template void LsTree::build_image(float* out) const;
+template void LsTree::build_image(double* out) const;
+
+/// Level line of a shape, empty if contours were not stored.
+std::vector<LsPoint> LsTree::contour(const LsShape* pShape) const {
+    std::vector<LsPoint> curve;
+    contours.decode(pShape->contourStart, pShape->contourCode,
+                    pShape->contourSize, curve);
+    return curve;
 }
 
 /// Smallest non-removed shape at pixel (\a x,\a y).
 LsShape* LsTree::smallest_shape(int x, int y) {
-    LsShape* pShape = smallestShape[y*ncol + x];
+    LsShape* pShape = smallestShape[(LsIndex)y*ncol + x];
     if(pShape->bIgnore)
         pShape = pShape->find_parent();
     return pShape;
 }
-/// Smallest non-removed shape at pixel (\a x,\a y).
-LsShape* LsTree::smallest_shape(int i) {
+/// Smallest non-removed shape at pixel of index \a i.
+LsShape* LsTree::smallest_shape(LsIndex i) {
     LsShape* pShape = smallestShape[i];
     if(pShape->bIgnore)
         pShape = pShape->find_parent();
     return pShape;
 }
+
+/// Number the shapes that are not ignored, preserving their order. Fill
+/// \a index with the new index of the smallest non-removed shape containing
+/// each shape. Return the number of non-removed shapes.
+/// The root must not be ignored.
+LsIndex LsTree::index_kept_shapes(std::vector<LsIndex>& index) const {
+    index.resize(iNbShapes);
+    LsIndex n = 0;
+    for(LsIndex i = 0; i < iNbShapes; i++) {
+        const LsShape& s = shape(i);
+        if(! s.bIgnore)
+            index[i] = n++;
+        else {
+            assert(s.parent); // Parent comes before
+            index[i] = index[s.parent->shapeId];
+        }
+    }
+    return n;
+}
+
+/// Remove the ignored shapes, in linear time. Links and smallest shapes of
+/// pixels are remapped, so that walking the tree does not need to skip
+/// ignored shapes anymore. Areas, pixels and types are not modified.
+void LsTree::compact() {
+    std::vector<LsIndex> index;
+    LsIndex n = index_kept_shapes(index);
+    if(n == iNbShapes)
+        return;
+    // New parents and smallest shapes of pixels, found before any shape is
+    // moved: moving shape i to k overwrites the shapeId of shape k.
+    std::vector<LsIndex> parent(n);
+    for(LsIndex i = 0; i < iNbShapes; i++) {
+        LsShape& s = shape(i);
+        if(s.bIgnore)
+            continue;
+        parent[index[i]] = s.parent? index[s.parent->shapeId]: -1;
+        assert(parent[index[i]] == (s.parent? index[s.find_parent()->shapeId]: -1));
+    }
+    for(LsIndex i = (LsIndex)nrow*ncol-1; i >= 0; i--)
+        smallestShape[i] = &shape(index[smallestShape[i]->shapeId]);
+#ifndef NDEBUG
+    // Gray levels of the parents in the uncompacted tree, to check the moves
+    std::vector<double> parentGray(n);
+    for(LsIndex i = 0; i < iNbShapes; i++)
+        if(! shape(i).bIgnore && shape(i).parent)
+            parentGray[index[i]] = shape(i).find_parent()->gray;
+#endif
+    for(LsIndex i = 0; i < iNbShapes; i++) {
+        LsIndex k = index[i]; // k <= i, so shape(k) is already moved
+        if(! shape(i).bIgnore && k != i)
+            shape(k) = shape(i);
+    }
+    for(LsIndex k = 0; k < n; k++)
+        shape(k).child = shape(k).sibling = 0;
+    for(LsIndex k = 0; k < n; k++) {
+        LsShape& s = shape(k);
+        s.shapeId = k;
+        s.parent = (parent[k] < 0)? 0: &shape(parent[k]);
+        if(s.parent) {
+            s.sibling = s.parent->child;
+            s.parent->child = &s;
+            assert(s.parent->gray == parentGray[k]);
+        }
+    }
+    iNbShapes = n;
+}
@@ -4,22 +4,67 @@
 #include "shape_double.h"
 
 /// Tree of shapes.
+/// Pixels may be of type uint8_t, uint16_t, float or double, the gray levels
+/// of shapes being stored as double in any case.
+/// Shapes are stored in chunks allocated as needed, and are accessed by
+/// their index with \c shape(). The storage is kept by \c reset(), so that
+/// the trees of a sequence of images can be computed without allocating it
+/// again.
 struct LsTree {
-    LsTree(const double* gray, int w, int h);
+    typedef enum {FLST, UNION_FIND, PARALLEL} Algo;
+
+    LsTree();
+    template <typename T>
+    LsTree(const T* gray, int w, int h, Algo algo = FLST,
+           bool bContours = false);
     ~LsTree();
+    template <typename T>
+    void reset(const T* gray, int w, int h, Algo algo = FLST,
+               bool bContours = false);
+
+    LsShape& shape(LsIndex i); ///< Shape of index \a i
+    const LsShape& shape(LsIndex i) const;
+    size_t memory() const; ///< Number of bytes allocated
+    static bool supports(size_t w, size_t h, Algo algo = FLST);
+    static size_t memory_estimate(size_t w, size_t h, size_t nbShapes,
+                                  Algo algo = FLST);
 
     double* build_image() const;
+    template <typename T> void build_image(T* out) const;
+    std::vector<LsPoint> contour(const LsShape* pShape) const;
     LsShape* smallest_shape(int x, int y);
-    LsShape* smallest_shape(int i);
+    LsShape* smallest_shape(LsIndex i);
+    LsIndex index_kept_shapes(std::vector<LsIndex>& index) const;
+    LsShape* new_shape();
+    void compact();
 
     int ncol, nrow; ///< Dimensions of image
-    LsShape* shapes; ///< The array of shapes
-    int iNbShapes; ///< The number of shapes
+    LsIndex iNbShapes; ///< The number of shapes
 
     /// For each pixel, the smallest shape containing it
-    LsShape** smallestShape;
+    std::vector<LsShape*> smallestShape;
+
+    bool bContours; ///< Are level lines stored? Only with the FLST algo
+    LsChainCode contours; ///< Level lines of all shapes
 private:
-    void flst_td(const double* gray); ///< Top-down algo
+    template <typename T>
+    void flst_td(const T* gray); ///< Top-down algo
+    template <typename T>
+    void flst_uf(const T* gray, int nbThreads); ///< Union-find algo
+    void reserve(LsIndex nbShapes);
+
+    static const int CHUNK_BITS = 12; ///< 2^CHUNK_BITS shapes per chunk
+    std::vector<LsShape*> chunks; ///< Storage of the shapes
+    std::vector<LsPoint> allPixels; ///< Storage of the pixels of the shapes
+
+    LsTree(const LsTree&); // Not copyable
+    LsTree& operator=(const LsTree&);
 };
 
+inline LsShape& LsTree::shape(LsIndex i)
+{ return chunks[i >> CHUNK_BITS][i & ((1 << CHUNK_BITS) - 1)]; }
+
+inline const LsShape& LsTree::shape(LsIndex i) const
+{ return chunks[i >> CHUNK_BITS][i & ((1 << CHUNK_BITS) - 1)]; }
+
 #endif